@@ -0,0 +1,68 @@
+#ifndef CRATERFIELD_H
+#define CRATERFIELD_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Seeded procedural impact craters on a sphere, indexed for sampling
+ * 
+ * Craters are scattered uniformly over the sphere with a power-law size
+ * distribution (many small craters, few large basins). A uniform grid over
+ * (theta, phi) lists in every cell the craters whose area of influence
+ * (bowl plus raised rim) overlaps it, so a surface sample only evaluates
+ * the craters of its own cell instead of the whole field.
+ * 
+ * Positions use the moon's spherical coordinates: theta is the polar angle
+ * in [0, pi] from +Y and phi the azimuth, wrapped into [0, 2 pi). Distances
+ * are great-circle angles, so craters stay round near the poles and
+ * continue across phi = 0.
+ */
+class CraterField {
+public:
+    struct Crater {
+        float theta, phi;   // Center
+        float radius;       // Angular radius of the bowl (radians)
+        float depth;        // Bowl depth, in the units of the displacement
+    };
+    
+    CraterField();
+    
+    // Replaces the field with count craters drawn from seed, with radii in
+    // [minRadius, maxRadius] distributed as N(> r) ~ r^-exponent
+    void generate(uint32_t seed, int count, float minRadius, float maxRadius,
+                  float exponent = 2.0f);
+    
+    // Summed crater profiles at a point: negative in bowls, positive on rims
+    float displacement(float theta, float phi) const;
+    
+    int getCraterCount() const { return static_cast<int>(craters.size()); }
+    const Crater& getCrater(int index) const { return craters[index]; }
+    
+private:
+    // Per crater values used by displacement()
+    struct CraterSample {
+        float x, y, z;              // Unit vector to the center
+        float inverseRadius;
+        float depth;
+        float influenceChord2;      // Squared chord length of the influence radius
+    };
+    
+    std::vector<Crater> craters;
+    std::vector<CraterSample> samples;
+    
+    // Grid: the craters of cell (t, p) are
+    // cellCraters[cellStart[t * cellsPhi + p] .. cellStart[t * cellsPhi + p + 1])
+    int cellsTheta;
+    int cellsPhi;
+    float cellsPerRadianTheta;
+    float cellsPerRadianPhi;
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> cellCraters;
+    
+    void buildIndex(float cellSize);
+    template <typename Visit>
+    void forEachCell(const Crater& crater, Visit visit) const;
+};
+
+#endif // CRATERFIELD_H
@@ -0,0 +1,227 @@
+#ifndef DEPTH_FORMATS_H
+#define DEPTH_FORMATS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include "Simd.h"
+
+/*
+ * Depth buffer formats for Rasterizer's templated fill loop.
+ *
+ * Fragment depth arrives as a float in [0, 1] (1 = far plane): the
+ * rasterizer maps the vertices' NDC z from [-1, 1] when it sets up a
+ * triangle, so the unorm formats cover the whole view volume. Every format
+ * is a stateless struct, so the compare and store compile into the fill
+ * loop of each pixel shader:
+ *
+ *   Type                        stored value
+ *   FAR_VALUE                   value a cleared buffer holds
+ *   NEAR_VALUE                  lowest value the format can store
+ *   encode(z) / decode(d)       depth <-> stored value
+ *   test(stored, z)             depth test for one pixel; stores z if it passes
+ *   test4(stored, z, mask)      the same for four SSE2 lanes masked by coverage,
+ *                               returning the lanes that passed
+ *   equal4(stored, z)           lanes whose depth encodes to the stored value
+ *   sortKey(d) / fromSortKey(k) stored value <-> 32-bit key ordered like it
+ *   sortKey4(z)                 sortKey(encode(z)) of four SSE2 lanes
+ *
+ * The sort keys are the depth half of the sort-last mode's atomic words, so
+ * that mode tests exactly what the binned fill loops do.
+ *
+ * DepthEqual<Format> wraps a format with the Z-equal test of a shading pass
+ * after a depth prepass: it passes fragments at exactly the stored depth and
+ * never writes.
+ *
+ * The unorm formats round z to the nearest step before comparing, so the
+ * test is an integer compare against the stored value. decode() is exact
+ * to within half a step, which keeps hierarchical Z conservative and makes
+ * encode(decode(d)) == d.
+ */
+
+/**
+ * @brief 32-bit float depth (the default)
+ */
+struct DepthFloat32 {
+    typedef float Type;
+    static constexpr float FAR_VALUE = 1.0f;
+    // Depths a hair below 0 survive the rounding of the [0, 1] mapping
+    static constexpr float NEAR_VALUE = -std::numeric_limits<float>::infinity();
+
+    static Type encode(float z) { return z; }
+    static float decode(Type d) { return d; }
+
+    static bool test(Type& stored, float z) {
+        if (!(z < stored)) return false;
+        stored = z;
+        return true;
+    }
+#ifdef LUMINA_SSE2
+    static __m128 test4(Type* stored, __m128 z, __m128 mask) {
+        __m128 old = _mm_loadu_ps(stored);
+        __m128 pass = _mm_and_ps(mask, _mm_cmplt_ps(z, old));
+        if (_mm_movemask_ps(pass)) {
+            _mm_storeu_ps(stored, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, old)));
+        }
+        return pass;
+    }
+    static __m128 equal4(const Type* stored, __m128 z) {
+        return _mm_cmpeq_ps(z, _mm_loadu_ps(stored));
+    }
+#endif
+    
+    // Float bits order like the float once negative values have all bits
+    // flipped and the others the sign bit set
+    static uint32_t sortKey(Type d) {
+        uint32_t bits;
+        std::memcpy(&bits, &d, sizeof(bits));
+        return bits ^ ((bits >> 31) ? 0xFFFFFFFFu : 0x80000000u);
+    }
+    static Type fromSortKey(uint32_t key) {
+        uint32_t bits = key ^ ((key >> 31) ? 0x80000000u : 0xFFFFFFFFu);
+        Type d;
+        std::memcpy(&d, &bits, sizeof(d));
+        return d;
+    }
+#ifdef LUMINA_SSE2
+    static __m128i sortKey4(__m128 z) {
+        __m128i bits = _mm_castps_si128(z);
+        __m128i flip = _mm_or_si128(_mm_srai_epi32(bits, 31), _mm_set1_epi32(INT32_MIN));
+        return _mm_xor_si128(bits, flip);
+    }
+#endif
+};
+
+/**
+ * @brief Rounding of [0, 1] depth to BITS-bit unsigned normalized integers
+ */
+template <int BITS>
+struct UnormDepth {
+    static constexpr uint32_t MAX_VALUE = (1u << BITS) - 1;
+
+    static uint32_t quantize(float z) {
+        float scaled = std::min(std::max(z, 0.0f), 1.0f) * MAX_VALUE + 0.5f;
+        return static_cast<uint32_t>(std::min(scaled, static_cast<float>(MAX_VALUE)));
+    }
+    static float decode(uint32_t d) { return d / static_cast<float>(MAX_VALUE); }
+
+#ifdef LUMINA_SSE2
+    static __m128i quantize4(__m128 z) {
+        const __m128 maxValue = _mm_set1_ps(static_cast<float>(MAX_VALUE));
+        __m128 clamped = _mm_min_ps(_mm_max_ps(z, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        __m128 scaled = _mm_add_ps(_mm_mul_ps(clamped, maxValue), _mm_set1_ps(0.5f));
+        return _mm_cvttps_epi32(_mm_min_ps(scaled, maxValue));
+    }
+#endif
+};
+
+/**
+ * @brief 16-bit unorm depth: half the memory traffic of float depth
+ *
+ * Enough for scenes with a short depth range relative to the near plane;
+ * larger ranges show z-fighting where surfaces are close together.
+ */
+struct DepthUnorm16 : UnormDepth<16> {
+    typedef uint16_t Type;
+    static constexpr Type FAR_VALUE = 0xFFFF;
+    static constexpr Type NEAR_VALUE = 0;
+
+    static Type encode(float z) { return static_cast<Type>(quantize(z)); }
+
+    static bool test(Type& stored, float z) {
+        uint32_t q = quantize(z);
+        if (!(q < stored)) return false;
+        stored = static_cast<Type>(q);
+        return true;
+    }
+#ifdef LUMINA_SSE2
+    static __m128 test4(Type* stored, __m128 z, __m128 mask) {
+        __m128i* target = reinterpret_cast<__m128i*>(stored);
+        __m128i old = _mm_unpacklo_epi16(_mm_loadl_epi64(target), _mm_setzero_si128());
+        __m128i q = quantize4(z);
+        __m128i pass = _mm_and_si128(_mm_castps_si128(mask), _mm_cmplt_epi32(q, old));
+        if (_mm_movemask_epi8(pass)) {
+            __m128i result = _mm_or_si128(_mm_and_si128(pass, q), _mm_andnot_si128(pass, old));
+            // SSE2 only packs to signed 16 bits: shift into its range and back
+            __m128i packed = _mm_packs_epi32(_mm_sub_epi32(result, _mm_set1_epi32(0x8000)),
+                                             _mm_setzero_si128());
+            _mm_storel_epi64(target, _mm_xor_si128(packed, _mm_set1_epi16(-0x8000)));
+        }
+        return _mm_castsi128_ps(pass);
+    }
+    static __m128 equal4(const Type* stored, __m128 z) {
+        __m128i old = _mm_unpacklo_epi16(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(stored)), _mm_setzero_si128());
+        return _mm_castsi128_ps(_mm_cmpeq_epi32(quantize4(z), old));
+    }
+    static __m128i sortKey4(__m128 z) { return quantize4(z); }
+#endif
+    
+    static uint32_t sortKey(Type d) { return d; }
+    static Type fromSortKey(uint32_t key) { return static_cast<Type>(key); }
+};
+
+/**
+ * @brief 24-bit unorm depth in the low bits of a 32-bit word (D24X8)
+ *
+ * Same footprint as float depth, but with uniform precision over [0, 1]
+ * and an integer compare.
+ */
+struct DepthUnorm24 : UnormDepth<24> {
+    typedef uint32_t Type;
+    static constexpr Type FAR_VALUE = 0xFFFFFF;
+    static constexpr Type NEAR_VALUE = 0;
+
+    static Type encode(float z) { return quantize(z); }
+
+    static bool test(Type& stored, float z) {
+        uint32_t q = quantize(z);
+        if (!(q < stored)) return false;
+        stored = q;
+        return true;
+    }
+#ifdef LUMINA_SSE2
+    static __m128 test4(Type* stored, __m128 z, __m128 mask) {
+        __m128i* target = reinterpret_cast<__m128i*>(stored);
+        __m128i old = _mm_loadu_si128(target);
+        __m128i q = quantize4(z);
+        // Values stay below 2^24, so the signed compare is exact
+        __m128i pass = _mm_and_si128(_mm_castps_si128(mask), _mm_cmplt_epi32(q, old));
+        if (_mm_movemask_epi8(pass)) {
+            _mm_storeu_si128(target, _mm_or_si128(_mm_and_si128(pass, q),
+                                                  _mm_andnot_si128(pass, old)));
+        }
+        return _mm_castsi128_ps(pass);
+    }
+    static __m128 equal4(const Type* stored, __m128 z) {
+        __m128i old = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stored));
+        return _mm_castsi128_ps(_mm_cmpeq_epi32(quantize4(z), old));
+    }
+    static __m128i sortKey4(__m128 z) { return quantize4(z); }
+#endif
+    
+    static uint32_t sortKey(Type d) { return d; }
+    static Type fromSortKey(uint32_t key) { return static_cast<Type>(key); }
+};
+
+/**
+ * @brief Z-equal test in Format: passes where the depth encodes to the stored
+ * value, leaving the depth buffer unchanged
+ *
+ * The prepass and the shading pass evaluate depth in the same fill loop,
+ * so a surface reproduces its prepass depths bit for bit.
+ */
+template <typename Format>
+struct DepthEqual : Format {
+    typedef typename Format::Type Type;
+
+    static bool test(Type& stored, float z) { return Format::encode(z) == stored; }
+#ifdef LUMINA_SSE2
+    static __m128 test4(Type* stored, __m128 z, __m128 mask) {
+        return _mm_and_ps(mask, Format::equal4(stored, z));
+    }
+#endif
+};
+
+#endif // DEPTH_FORMATS_H
@@ -7,6 +7,7 @@
 #include <string>
 #include "Rasterizer.h"
 #include "Transform.h"
+#include "CraterField.h"
 #include "Shaders.h"
 
 /**
@@ -54,6 +55,7 @@ private:
     float rotationY;
     float rotationZ;
     float scale;
+    bool modelMatrixDirty;      // Rotation or scale changed since the last update()
     
     // Camera parameters
     glm::vec3 cameraPos;
@@ -65,6 +67,43 @@ private:
     glm::vec3 lightColor;
     glm::vec3 ambientColor;
     
+    // Moon lighting and material (also used by the visibility buffer resolve)
+    Light moonLight;
+    Material moonMaterial;
+    ShadingModel shadingModel;
+    CullMode cullMode;          // Face culling applied to the moon
+    bool depthPrepass;          // Moon drawn as a depth prepass plus a Z-equal shading pass
+    bool deferMoonLighting;     // Vertex lighting waits for this frame's prepass
+    
+    // Moon geometry parameters; set moonMeshDirty after changing them
+    int moonLatSegments;
+    int moonLonSegments;
+    float moonRadius;
+    bool moonMeshDirty;         // The mesh is rebuilt before the next frame
+    
+    // Procedural craters, regenerated with the mesh
+    uint32_t craterSeed;
+    int craterCount;
+    float craterMinRadius;      // Angular radii of the power-law size range
+    float craterMaxRadius;
+    CraterField craterField;
+    
+    // Cached moon mesh (model space): one entry per shared grid vertex, with
+    // the positions in structure-of-arrays layout for Transform::transformVertices
+    std::vector<float> moonMeshX;
+    std::vector<float> moonMeshY;
+    std::vector<float> moonMeshZ;
+    std::vector<glm::vec3> moonMeshNormals;
+    std::vector<uint32_t> moonMeshIndices;
+    
+    // Per-frame moon batch submitted with Rasterizer::drawIndexed: the
+    // transformed mesh vertices (clip fans appended) and assembled triangles
+    std::vector<Vertex> moonVertices;
+    std::vector<glm::vec4> moonClipPositions;  // Clip space, per mesh vertex
+    std::vector<glm::vec4> moonScreenPositions;  // (x, y, NDC z, 1/w), per mesh vertex
+    std::vector<uint8_t> moonVertexLit;        // Per entry of moonVertices
+    std::vector<uint32_t> moonIndices;
+    
     // Rendering methods
     void update(float deltaTime);
     void render();
@@ -76,9 +115,20 @@ private:
     void drawLine(float x1, float y1, float x2, float y2, float r, float g, float b, float width = 1.0f);
     void drawCube();
     void drawMoon();
-    void drawMoonTriangle(const glm::vec4& v1, const glm::vec4& v2, const glm::vec4& v3,
-                          const glm::vec3& n1, const glm::vec3& n2, const glm::vec3& n3,
-                          const Light& light, const Material& material);
+    void buildMoonMesh();
+    void drawMoonWithPrepass();
+    void transformMoonVertices(const glm::mat4& model, const glm::mat3& normalMatrix);
+    void addMoonTriangle(uint32_t i1, uint32_t i2, uint32_t i3,
+                         const glm::mat4& model, const glm::mat3& normalMatrix);
+    void emitMoonTriangle(uint32_t i1, uint32_t i2, uint32_t i3);
+    glm::vec4 projectToScreen(const glm::vec4& clipPos) const;
+    glm::vec4 moonMeshPosition(uint32_t index) const {
+        return glm::vec4(moonMeshX[index], moonMeshY[index], moonMeshZ[index], 1.0f);
+    }
+    Vertex makeMoonVertex(const glm::vec4& screenPos, const glm::vec4& position, 
+                          const glm::vec3& normal, const glm::mat4& model,
+                          const glm::mat3& normalMatrix);
+    void lightMoonVertex(Vertex& vertex, const Light& light, const Material& material);
     void drawLightSource();
     void drawLightTriangle(const glm::vec4& v1, const glm::vec4& v2, const glm::vec4& v3);
     float generateCraterDisplacement(float theta, float phi);
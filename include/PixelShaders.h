@@ -0,0 +1,169 @@
+#ifndef PIXEL_SHADERS_H
+#define PIXEL_SHADERS_H
+
+#include <glm/glm.hpp>
+#include "Rasterizer.h"
+#include "Shaders.h"
+#include "Simd.h"
+
+/**
+ * @brief Per-draw state read by the fragment stage (lighting for Phong)
+ */
+struct ShaderUniforms {
+    Light light;
+    Material material;
+    glm::vec3 viewPos;
+
+    ShaderUniforms() : viewPos(0.0f) {}
+};
+
+/**
+ * @brief What the edge function fill loop writes for a visible pixel
+ */
+enum ShaderOutput {
+    OUTPUT_COLOR = 0,         // Depth and color
+    OUTPUT_DEPTH_ONLY = 1,    // Depth only
+    OUTPUT_PRIMITIVE_ID = 2   // Depth and triangle ID (visibility buffer)
+};
+
+/*
+ * Pixel shaders for Rasterizer's templated fill loop.
+ *
+ * Every shader is a stateless struct with compile-time layout and static
+ * stage functions, so each one instantiates its own inner loop without
+ * virtual calls or per-pixel branches:
+ *
+ *   OUTPUT, VARYING_COUNT               what is written / interpolated
+ *   constants(provoking, c)             per-triangle flat values (up to 4)
+ *   varyings(vertex, v)                 vertex stage: values interpolated
+ *                                       perspective-correctly over the triangle
+ *   shade(v, c, uniforms, rgb)          fragment stage for one pixel
+ *   shade4(v, c, uniforms, rgb)         the same for four SSE2 lanes
+ *
+ * Fragment colors are floats in [0, 255]; the fill loop clamps and packs.
+ */
+
+/**
+ * @brief Flat shading: the first (provoking) vertex's color for the whole triangle
+ */
+struct FlatShader {
+    static const ShaderOutput OUTPUT = OUTPUT_COLOR;
+    static const int VARYING_COUNT = 0;
+
+    static void constants(const Vertex& provoking, float* c) {
+        c[0] = provoking.color.r;
+        c[1] = provoking.color.g;
+        c[2] = provoking.color.b;
+    }
+    static void varyings(const Vertex&, float*) {}
+
+    static void shade(const float*, const float* c, const ShaderUniforms&, float* rgb) {
+        rgb[0] = c[0];
+        rgb[1] = c[1];
+        rgb[2] = c[2];
+    }
+#ifdef LUMINA_SSE2
+    static void shade4(const __m128*, const float* c, const ShaderUniforms&, __m128* rgb) {
+        rgb[0] = _mm_set1_ps(c[0]);
+        rgb[1] = _mm_set1_ps(c[1]);
+        rgb[2] = _mm_set1_ps(c[2]);
+    }
+#endif
+};
+
+/**
+ * @brief Gouraud shading: interpolates the per-vertex lit colors
+ */
+struct GouraudShader {
+    static const ShaderOutput OUTPUT = OUTPUT_COLOR;
+    static const int VARYING_COUNT = 3;
+
+    static void constants(const Vertex&, float*) {}
+    static void varyings(const Vertex& v, float* out) {
+        out[0] = v.color.r;
+        out[1] = v.color.g;
+        out[2] = v.color.b;
+    }
+
+    static void shade(const float* v, const float*, const ShaderUniforms&, float* rgb) {
+        rgb[0] = v[0];
+        rgb[1] = v[1];
+        rgb[2] = v[2];
+    }
+#ifdef LUMINA_SSE2
+    static void shade4(const __m128* v, const float*, const ShaderUniforms&, __m128* rgb) {
+        rgb[0] = v[0];
+        rgb[1] = v[1];
+        rgb[2] = v[2];
+    }
+#endif
+};
+
+/**
+ * @brief Phong shading: Blinn-Phong per pixel from interpolated world position and normal
+ */
+struct PhongShader {
+    static const ShaderOutput OUTPUT = OUTPUT_COLOR;
+    static const int VARYING_COUNT = 6;  // worldPos.xyz, normal.xyz
+
+    static void constants(const Vertex&, float*) {}
+    static void varyings(const Vertex& v, float* out) {
+        out[0] = v.worldPos.x;
+        out[1] = v.worldPos.y;
+        out[2] = v.worldPos.z;
+        out[3] = v.normal.x;
+        out[4] = v.normal.y;
+        out[5] = v.normal.z;
+    }
+
+    static void shade(const float* v, const float*, const ShaderUniforms& u, float* rgb) {
+        Color color = Shaders::computePhongShading(glm::vec3(v[0], v[1], v[2]),
+                                                   glm::vec3(v[3], v[4], v[5]),
+                                                   u.viewPos, u.light, u.material);
+        rgb[0] = color.r;
+        rgb[1] = color.g;
+        rgb[2] = color.b;
+    }
+#ifdef LUMINA_SSE2
+    static void shade4(const __m128* v, const float*, const ShaderUniforms& u, __m128* rgb) {
+        // SoA Blinn-Phong: v[0..2] are the positions, v[3..5] the normals of four pixels
+        Shaders::computePhongShading4(v, v + 3, u.viewPos, u.light, u.material, rgb);
+        const __m128 scale = _mm_set1_ps(255.0f);
+        rgb[0] = _mm_mul_ps(rgb[0], scale);
+        rgb[1] = _mm_mul_ps(rgb[1], scale);
+        rgb[2] = _mm_mul_ps(rgb[2], scale);
+    }
+#endif
+};
+
+/**
+ * @brief Depth only: no varyings and no color writes (e.g. a depth prepass)
+ */
+struct DepthOnlyShader {
+    static const ShaderOutput OUTPUT = OUTPUT_DEPTH_ONLY;
+    static const int VARYING_COUNT = 0;
+
+    static void constants(const Vertex&, float*) {}
+    static void varyings(const Vertex&, float*) {}
+    static void shade(const float*, const float*, const ShaderUniforms&, float*) {}
+#ifdef LUMINA_SSE2
+    static void shade4(const __m128*, const float*, const ShaderUniforms&, __m128*) {}
+#endif
+};
+
+/**
+ * @brief Visibility buffer: writes the triangle ID; shading happens in the resolve pass
+ */
+struct PrimitiveIdShader {
+    static const ShaderOutput OUTPUT = OUTPUT_PRIMITIVE_ID;
+    static const int VARYING_COUNT = 0;
+
+    static void constants(const Vertex&, float*) {}
+    static void varyings(const Vertex&, float*) {}
+    static void shade(const float*, const float*, const ShaderUniforms&, float*) {}
+#ifdef LUMINA_SSE2
+    static void shade4(const __m128*, const float*, const ShaderUniforms&, __m128*) {}
+#endif
+};
+
+#endif // PIXEL_SHADERS_H
@@ -2,9 +2,15 @@
 #define RASTERIZER_H
 
 #include <glm/glm.hpp>
+#include <atomic>
 #include <vector>
 #include <cstdint>
 
+class ThreadPool;
+struct Light;
+struct Material;
+struct ShaderUniforms;
+
 /**
  * @brief Structure to represent a color in RGBA format
  */
@@ -19,7 +25,7 @@ struct Color {
  * @brief Structure to represent a vertex with position, color, and normal
  */
 struct Vertex {
-    glm::vec4 position;     // Homogeneous coordinates (x, y, z, w)
+    glm::vec4 position;     // Homogeneous coordinates; in screen space (x, y, NDC z, 1/w)
     glm::vec3 worldPos;     // World space position for lighting
     glm::vec3 normal;       // Normal vector for lighting calculations
     Color color;            // Vertex color
@@ -27,13 +33,76 @@ struct Vertex {
     Vertex() : position(0.0f), worldPos(0.0f), normal(0.0f, 0.0f, 1.0f), color() {}
 };
 
+/**
+ * @brief Triangle fill algorithms selectable at runtime
+ */
+enum RasterMode {
+    RASTER_SCANLINE = 0,       // Flat-top/flat-bottom split, barycentrics per pixel
+    RASTER_EDGE_FUNCTION = 1   // Half-space test over 8x8 blocks, incremental stepping
+};
+
+/**
+ * @brief How flush() spreads edge function triangles over the threads
+ */
+enum ParallelMode {
+    PARALLEL_TILE_BINNING = 0,   // Sort-middle: per-tile triangle lists, one thread per tile
+    PARALLEL_SORT_LAST = 1       // Any thread, any triangle: atomic-min on (depth, color) words
+};
+
+/**
+ * @brief Pixel shading used by the edge function rasterizer and the
+ * visibility buffer resolve pass
+ */
+enum ShadingModel {
+    SHADING_GOURAUD = 0,   // Interpolate the vertex colors
+    SHADING_PHONG = 1,     // Per-pixel Blinn-Phong from interpolated normals
+    SHADING_FLAT = 2,      // First vertex's color for the whole triangle
+    SHADING_DEPTH_ONLY = 3 // Depth writes only (forward rendering)
+};
+
+/**
+ * @brief Which triangles are discarded by face culling
+ * 
+ * Front faces are counter-clockwise in NDC (the OpenGL convention).
+ */
+enum CullMode {
+    CULL_NONE = 0,    // Draw both faces
+    CULL_BACK = 1,    // Discard triangles facing away from the viewer
+    CULL_FRONT = 2    // Discard triangles facing the viewer
+};
+
+/**
+ * @brief Memory layout of the presented frame buffer
+ */
+enum PixelFormat {
+    PIXEL_RGB8 = 0,    // 3 bytes per pixel: R, G, B
+    PIXEL_RGBA8 = 1    // 4 bytes per pixel: R, G, B, A (same as the internal color buffer)
+};
+
+/**
+ * @brief Storage format of the depth buffer (see DepthFormats.h)
+ */
+enum DepthFormat {
+    DEPTH_FLOAT32 = 0,   // 4 bytes per pixel, float
+    DEPTH_UNORM24 = 1,   // 4 bytes per pixel, 24-bit integer (D24X8)
+    DEPTH_UNORM16 = 2    // 2 bytes per pixel, 16-bit integer
+};
+
+/**
+ * @brief Depth comparison of the triangle fill loops
+ */
+enum DepthTest {
+    DEPTH_TEST_LESS = 0,   // Nearer than the stored depth; stores the new depth
+    DEPTH_TEST_EQUAL = 1   // Exactly the stored depth, no depth write (after a prepass)
+};
+
 /**
  * @brief Rasterizer class implementing manual drawing algorithms
  * 
  * This class provides manual implementations of:
  * - Bresenham's Line Algorithm
  * - Mid-Point Circle Algorithm
- * - Triangle Rasterization
+ * - Triangle Rasterization (scanline and edge function)
  * - Z-Buffer (Depth Buffer) management
  */
 class Rasterizer {
@@ -41,9 +110,41 @@ public:
     Rasterizer(int width, int height);
     ~Rasterizer();
     
-    // Buffer management
+    // Buffer management (clears are deferred per tile, see clearBuffers()).
+    // Rendering goes to tiled internal buffers; getFrameBuffer() linearizes
+    // them into a row-major frame buffer.
     void clearBuffers(const Color& clearColor = Color(0, 0, 0, 255));
-    uint8_t* getFrameBuffer() const { return frameBuffer; }
+    uint8_t* getFrameBuffer();
+    
+    // Presented frame buffer layout; it can be uploaded as-is (GL_RGB / GL_RGBA)
+    void setPixelFormat(PixelFormat format);
+    PixelFormat getPixelFormat() const { return pixelFormat; }
+    int getBytesPerPixel() const { return pixelFormat == PIXEL_RGBA8 ? 4 : 3; }
+    
+    // Depth buffer precision; integer formats quantize depth to 2^16 or 2^24 steps
+    void setDepthFormat(DepthFormat format);
+    DepthFormat getDepthFormat() const { return depthFormat; }
+    int getBytesPerDepth() const { return depthFormat == DEPTH_UNORM16 ? 2 : 4; }
+    
+    // Depth comparison for triangles submitted afterwards
+    void setDepthTest(DepthTest test);
+    DepthTest getDepthTest() const { return depthTest; }
+    
+    // Depth prepass (edge function mode, forward shading). Between
+    // beginDepthPrepass() and endDepthPrepass() triangles write depth and
+    // their prepass index only; triangle i is the i-th one passed to
+    // drawTriangle() or drawIndexed() since beginDepthPrepass(). Ending the
+    // prepass selects DEPTH_TEST_EQUAL and records which triangles own a
+    // visible pixel, so that the shading pass can skip the vertex work of
+    // the others. The shading pass submits the same triangles in the same
+    // order: hidden ones are dropped, and the others are drawn only on the
+    // pixels they own. (With MSAA every triangle counts as visible and the
+    // test compares sample depths.)
+    void beginDepthPrepass();
+    void endDepthPrepass();
+    bool isPrepassTriangleVisible(int index) const {
+        return index >= static_cast<int>(prepassVisible.size()) || prepassVisible[index];
+    }
     
     // Basic drawing primitives (manually implemented)
     void draw_line(int x1, int y1, int x2, int y2, const Color& color);
@@ -52,10 +153,87 @@ public:
     // Advanced drawing
     void drawTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3, 
                      bool useGouraud = true);
+    // alreadyCulled: the caller has run cullTriangle() on every triangle
+    void drawIndexed(const Vertex* vertices, const uint32_t* indices, int indexCount,
+                     bool useGouraud = true, bool alreadyCulled = false);
     void drawWireframeTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3, 
                               const Color& color);
     
-    // Pixel operations
+    // Pixel shading of the edge function path. Each model runs its own
+    // compile-time specialized fill loop (see PixelShaders.h).
+    void setShadingModel(ShadingModel model);
+    ShadingModel getShadingModel() const { return shadingModel; }
+    void setShaderUniforms(const Light& light, const Material& material, 
+                           const glm::vec3& viewPos);
+    
+    // Face culling (also drops zero-area triangles). cullTriangle() can be
+    // called on projected positions before any vertex shading is done.
+    void setCullMode(CullMode mode) { cullMode = mode; }
+    CullMode getCullMode() const { return cullMode; }
+    bool cullTriangle(const glm::vec4& p1, const glm::vec4& p2, const glm::vec4& p3);
+    int getCulledTriangleCount() const { return culledTriangles; }
+    
+    // Triangle fill algorithm selection
+    void setRasterMode(RasterMode mode) { rasterMode = mode; }
+    RasterMode getRasterMode() const { return rasterMode; }
+    
+    // Tile-binned multithreaded rasterization (edge function mode)
+    static const int TILE_SIZE = 64;
+    void setThreadCount(int count);
+    int getThreadCount() const;
+    void flush();
+    
+    // Sort-last alternative to tile binning: flush() splits the triangles
+    // evenly over the threads, each writing any pixel of a shared target of
+    // 64-bit (depth, color) words with atomic-min, then resolves the words
+    // into the color and depth buffers. Falls back to binning with MSAA.
+    void setParallelMode(ParallelMode mode);
+    ParallelMode getParallelMode() const { return parallelMode; }
+    
+    // Sub-pixel precision of the edge function rasterizer (28.4 fixed point).
+    // Triangles with a vertex farther than MAX_SCREEN_COORD pixels from the
+    // origin are rejected so that edge values stay within 32 bits per block;
+    // geometry clipped to the guard band (Transform::clipTriangle) never is.
+    static const int SUBPIXEL_BITS = 4;
+    static const int MAX_SCREEN_COORD = 1 << 17;
+    
+    // Small-triangle fast path (edge function mode, without MSAA): triangles
+    // whose bounding box is at most getSmallTriangleSize() pixels wide and high
+    // test their few pixel centers during setup. Those covering none are
+    // dropped before any attribute setup, the rest skip block classification.
+    static const int MAX_SMALL_TRIANGLE_SIZE = 8;
+    void setSmallTriangleSize(int pixels);  // 0 disables the fast path
+    int getSmallTriangleSize() const { return smallTriangleSize; }
+    
+    // Triangle size histogram since the last clearBuffers(), for tuning the
+    // threshold: bucket b counts triangles reaching setup whose bounding box is
+    // at most 2^b pixels on its longer side (the last bucket: all larger ones)
+    static const int SIZE_HISTOGRAM_BUCKETS = 8;
+    int getTriangleSizeCount(int bucket) const { return triangleSizeHistogram[bucket]; }
+    int getEmptySmallTriangleCount() const { return emptySmallTriangles; }
+    
+    // Hierarchical Z rejection of occluded triangles and 8x8 blocks
+    void setHierarchicalZ(bool enabled) { hierarchicalZ = enabled; }
+    bool getHierarchicalZ() const { return hierarchicalZ; }
+    
+    // Visibility buffer (deferred shading): rasterize depth + triangle ID only,
+    // then shade every visible pixel once in resolveVisibilityBuffer()
+    static const uint32_t NO_PRIMITIVE = 0xFFFFFFFFu;
+    void setVisibilityBuffer(bool enabled);
+    bool getVisibilityBuffer() const { return visibilityBuffer; }
+    void resolveVisibilityBuffer(ShadingModel model, const Light& light,
+                                 const Material& material, const glm::vec3& viewPos);
+    
+    // 4x multisample anti-aliasing (forward edge function shading): coverage
+    // and depth per sample, shading once per pixel per triangle. Samples are
+    // averaged into the frame buffer by getFrameBuffer(). Ignored while the
+    // visibility buffer is enabled.
+    static const int MSAA_SAMPLES = 4;
+    void setMultisampling(bool enabled);
+    bool getMultisampling() const { return multisampling; }
+    
+    // Pixel operations (depth is buffer depth in [0, 1]; triangle vertices
+    // carry NDC z in [-1, 1], which the rasterizer maps to it)
     void setPixel(int x, int y, const Color& color);
     void setPixelWithDepth(int x, int y, float depth, const Color& color);
     
@@ -66,8 +244,106 @@ public:
 private:
     int width;
     int height;
-    uint8_t* frameBuffer;    // RGB frame buffer (width * height * 3)
-    float* depthBuffer;      // Z-buffer for depth testing
+    uint8_t* frameBuffer;    // Presented frame buffer (width * height * getBytesPerPixel())
+    uint32_t* colorBuffer;   // Render target, packed RGBA in tiled order (see pixelIndex())
+    uint8_t* depthBuffer;    // Z-buffer for depth testing, tiled order, in depthFormat
+    int bufferSize;          // Pixels in each tiled buffer (padded to whole tiles)
+    PixelFormat pixelFormat; // Layout of frameBuffer
+    DepthFormat depthFormat; // Layout of depthBuffer and sampleDepths
+    DepthTest depthTest;     // Comparison of the fill loops
+    RasterMode rasterMode;   // Algorithm used by drawTriangle
+    CullMode cullMode;       // Faces discarded before setup
+    int culledTriangles;     // Triangles culled since the last clearBuffers()
+    int smallTriangleSize;   // Largest bounding box side of the small-triangle path
+    int triangleSizeHistogram[SIZE_HISTOGRAM_BUCKETS];  // Since the last clearBuffers()
+    int emptySmallTriangles; // Small triangles covering no pixel center
+    ShadingModel shadingModel;       // Forward pixel shading (edge function mode)
+    ShaderUniforms* shaderUniforms;  // Lighting for per-pixel shading
+    bool hierarchicalZ;      // Reject occluded triangles/blocks early
+    bool visibilityBuffer;   // Write triangle IDs instead of colors
+    uint32_t* primitiveBuffer;  // Triangle ID per pixel (visibility buffer mode or
+                                // prepass index), tiled order
+    bool depthPrepass;       // Between beginDepthPrepass() and endDepthPrepass()
+    uint32_t prepassTriangles;          // Triangles submitted to the current prepass
+    std::vector<uint8_t> prepassVisible;  // Per prepass triangle: owns a pixel
+    bool prepassOwners;      // Z-equal pass tests the prepass indices in primitiveBuffer
+    uint32_t equalPassTriangles;        // Triangles submitted since endDepthPrepass()
+    bool multisampling;      // 4x MSAA requested
+    uint32_t* sampleColors;  // MSAA_SAMPLES tiled planes of bufferSize packed RGBA colors
+    uint8_t* sampleDepths;   // MSAA_SAMPLES tiled planes of bufferSize depths, in depthFormat
+    
+    ParallelMode parallelMode;  // Tile binning or sort-last (multithreaded only)
+    std::atomic<uint64_t>* packedBuffer;  // Sort-last (depth key << 32 | color or ID), tiled order
+    std::vector<uint8_t> packedTiles;     // Tiles touched by the pending sort-last triangles
+    
+    // MSAA applies to forward shading only
+    bool multisampleActive() const { return multisampling && !visibilityBuffer; }
+    
+    // Sort-last applies to multithreaded edge function rasterization without
+    // MSAA, outside of a depth prepass and its Z-equal shading pass (the
+    // sort-last fill only has the less-than depth test)
+    bool sortLastActive() const { 
+        return parallelMode == PARALLEL_SORT_LAST && threadPool && !multisampleActive() &&
+               !depthPrepass && depthTest == DEPTH_TEST_LESS; 
+    }
+    
+    /**
+     * @brief Index of pixel (x, y) in the tiled buffers
+     * 
+     * Tiles are stored one after another in row-major tile order, the 8x8
+     * blocks of a tile likewise, and the pixels of a block row by row. Each
+     * tile is one contiguous 16 KB range of the color buffer and each 8x8
+     * block (the unit of the fill loop and of hierarchical Z) 256 bytes, so
+     * a block's rows no longer sit width * 4 bytes apart.
+     */
+    int pixelIndex(int x, int y) const {
+        return ((((y >> TILE_SHIFT) * tilesX + (x >> TILE_SHIFT)) << (2 * TILE_SHIFT)) |
+                (((y >> 3) & (TILE_SIZE / 8 - 1)) << (TILE_SHIFT + 3)) |
+                (((x >> 3) & (TILE_SIZE / 8 - 1)) << 6) | ((y & 7) << 3) | (x & 7));
+    }
+    static const int TILE_SHIFT = 6;
+    static_assert(TILE_SIZE == 1 << TILE_SHIFT, "TILE_SHIFT must match TILE_SIZE");
+    
+    // Lazy clears: state of the color, depth and ID buffers in each tile
+    enum TileState {
+        TILE_STALE = 0,    // Holds an old frame; must be cleared before use
+        TILE_DRAWN = 1     // Drawn to since the last clearBuffers()
+    };
+    std::vector<uint8_t> tileStates;
+    std::vector<uint8_t> presentedClear;  // Tile of frameBuffer shows the clear color
+    Color bufferClearColor;     // Color stale tiles are cleared to
+    
+    // Lazy clear helpers
+    void prepareTile(int tileIndex) {
+        if (tileStates[tileIndex] != TILE_DRAWN) {
+            clearTile(tileIndex);
+            tileStates[tileIndex] = TILE_DRAWN;
+        }
+    }
+    void clearTile(int tileIndex);
+    void clearSpan(int index, int count);
+    void invalidateTiles();
+    void resetPrimitiveIds();
+    uint32_t packClearColor() const;
+    
+    // Depth access in the current format; index counts pixels, so sample s
+    // of a pixel is at s * bufferSize + pixelIndex(x, y) in sampleDepths
+    bool testDepth(uint8_t* buffer, int index, float depth);
+    void fillDepth(uint8_t* buffer, int index, int count);
+    
+    // Writes an opaque color at a tiled pixel index (to all of the pixel's
+    // samples with MSAA)
+    void storePixel(int index, uint8_t r, uint8_t g, uint8_t b);
+    static uint32_t packColor(uint8_t r, uint8_t g, uint8_t b) {
+        return static_cast<uint32_t>(r) | (static_cast<uint32_t>(g) << 8) | 
+               (static_cast<uint32_t>(b) << 16) | 0xFF000000u;
+    }
+    
+    // Present: tiled buffers (or averaged MSAA samples) to the row-major frame buffer
+    void presentTile(int tileIndex);
+    void linearizeTile(int tileIndex);
+    void presentClearTile(int tileIndex);
+    void resolveSampleTile(int tileIndex);
     
     // Helper methods for Bresenham's algorithm
     void drawLineLow(int x1, int y1, int x2, int y2, const Color& color);
@@ -77,11 +353,148 @@ private:
     void drawCirclePoints(int xc, int yc, int x, int y, const Color& color);
     
     // Triangle rasterization helper
+    void drawScanlineTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3, 
+                              bool useGouraud);
     void fillFlatTopTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3, 
                             bool useGouraud);
     void fillFlatBottomTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3, 
                                bool useGouraud);
     
+    /**
+     * @brief Per-triangle data computed once before any pixel work
+     * 
+     * Edge functions are exact integers on the 28.4 fixed-point grid, stepped
+     * per pixel from their value at the first pixel of the bounding box. Depth,
+     * 1/w and every varying are AttributePlanes anchored at the first vertex.
+     * Varyings are stored pre-divided by w, so that they are affine in screen
+     * space; dividing by the interpolated 1/w gives the perspective-correct value.
+     */
+    struct AttributePlane {
+        float value, ddx, ddy;        // f(x, y) = value + ddx * (x - refX) + ddy * (y - refY)
+        
+        // The y term comes first, so a fill loop can compute it once per row
+        // and still match at() exactly
+        float rowValue(float dy) const { return value + ddy * dy; }
+        float at(float dx, float dy) const { return rowValue(dy) + ddx * dx; }
+    };
+    
+    static const int MAX_VARYINGS = 8;
+    static const int MAX_CONSTANTS = 4;
+    
+    // Fill loop instantiation used for a triangle
+    enum PixelShaderKind {
+        PIXEL_SHADER_FLAT = 0,
+        PIXEL_SHADER_GOURAUD = 1,
+        PIXEL_SHADER_PHONG = 2,
+        PIXEL_SHADER_DEPTH_ONLY = 3,
+        PIXEL_SHADER_PRIMITIVE_ID = 4
+    };
+    
+    struct TriangleSetup {
+        int32_t A[3], B[3];           // Edge steps per pixel in x and y
+        int64_t E0[3];                // Edge values at (minX, minY), fill rule bias included
+        float refX, refY;             // Plane anchor point (vertex 0)
+        AttributePlane depth;         // Buffer depth in [0, 1] (affine in screen space)
+        float minZ;                   // Nearest vertex depth
+        AttributePlane invW;          // 1 / w
+        AttributePlane varyings[MAX_VARYINGS];  // Varying / w (layout set by the shader)
+        float constants[MAX_CONSTANTS];         // Flat per-triangle values
+        int shader;                   // PixelShaderKind
+        int minX, minY, maxX, maxY;   // Bounding box clamped to the viewport
+        uint64_t coverage;            // Small triangles: covered pixel centers, bit
+                                      // (y - minY) * 8 + (x - minX); 0 otherwise
+        uint32_t primitiveId;         // Index into visibleTriangles (or prepass index)
+    };
+    
+    /**
+     * @brief Triangle kept for the visibility buffer resolve pass
+     * 
+     * Barycentric weights of vertices 1 and 2 are planes anchored at
+     * vertex 0, so reconstructing them at a pixel costs two multiply-adds each.
+     * They are screen-space weights; the resolve corrects them with invW.
+     */
+    struct VisibleTriangle {
+        Vertex v[3];
+        float invW[3];
+        float refX, refY;
+        float dl1dx, dl1dy;
+        float dl2dx, dl2dy;
+    };
+    std::vector<VisibleTriangle> visibleTriangles;
+    
+    // Edge function (half-space) rasterization
+    void submitTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3, bool useGouraud);
+    bool setupTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3,
+                       int shader, TriangleSetup& tri);
+    template <typename Shader>
+    static int setupShaderInputs(const Vertex* const vertices[3], 
+                                 float varyings[3][MAX_VARYINGS], float* constants);
+    void rasterizeTriangle(const TriangleSetup& tri, int clipMinX, int clipMinY,
+                           int clipMaxX, int clipMaxY);
+    bool rasterizeSmallTriangle(const TriangleSetup& tri, int minX, int minY, 
+                                int maxX, int maxY);
+    bool fillBlock(const TriangleSetup& tri, int bx, int by, const int32_t blockE[3],
+                   int partialEdges, int startX, int startY, int endX, int endY);
+    template <typename Depth>
+    bool fillBlockWithDepth(const TriangleSetup& tri, int bx, int by, const int32_t blockE[3],
+                            int partialEdges, int startX, int startY, int endX, int endY);
+    template <typename Shader, typename Target>
+    bool shadeBlockInto(const TriangleSetup& tri, int bx, int by, const int32_t blockE[3],
+                        int partialEdges, int startX, int startY, int endX, int endY,
+                        Target& target);
+    template <typename Shader, typename Depth>
+    bool shadeBlock(const TriangleSetup& tri, int bx, int by, const int32_t blockE[3],
+                    int partialEdges, int startX, int startY, int endX, int endY);
+    template <typename Depth>
+    bool fillBlockSortLast(const TriangleSetup& tri, int bx, int by, const int32_t blockE[3],
+                           int partialEdges, int startX, int startY, int endX, int endY);
+    template <typename Shader, typename Depth>
+    bool shadeBlockSortLast(const TriangleSetup& tri, int bx, int by, const int32_t blockE[3],
+                            int partialEdges, int startX, int startY, int endX, int endY);
+    template <typename Shader, typename Depth>
+    bool shadeBlockMultisample(const TriangleSetup& tri, int bx, int by, 
+                               const int32_t blockE[3], int partialEdges, 
+                               int startX, int startY, int endX, int endY);
+    bool fillBlockPrepassOwner(const TriangleSetup& tri, int bx, int by, const int32_t blockE[3],
+                               int partialEdges, int startX, int startY, int endX, int endY);
+    template <typename Shader>
+    bool shadeBlockPrepassOwner(const TriangleSetup& tri, int bx, int by, 
+                                const int32_t blockE[3], int partialEdges, 
+                                int startX, int startY, int endX, int endY);
+    
+    // Tile binning state
+    ThreadPool* threadPool;                        // nullptr = rasterize immediately
+    int tilesX, tilesY;
+    std::vector<TriangleSetup> binnedTriangles;    // Triangles waiting for flush()
+    std::vector<std::vector<uint32_t>> tileBins;   // Triangle indices per tile
+    
+    void binTriangle(const TriangleSetup& tri);
+    void rasterizeTile(int tileIndex);
+    
+    // Sort-last flush: load the touched tiles into packedBuffer, rasterize
+    // every triangle with atomic updates, store the tiles back
+    void flushSortLast();
+    template <typename Depth>
+    void packTile(int tileIndex);
+    template <typename Depth>
+    void unpackTile(int tileIndex);
+    
+    // Hierarchical Z: conservative farthest depth per 8x8 block and per tile.
+    // Depth only ever decreases between clears, so a stale value is still safe.
+    int blocksX, blocksY;
+    std::vector<float> blockMaxDepth;
+    std::vector<float> tileMaxDepth;
+    
+    void updateBlockMaxDepth(int blockIndex);
+    template <typename Depth>
+    float farthestDepthInBlock(int blockIndex) const;
+    void updateTileMaxDepth(int tileIndex);
+    
+    // Visibility buffer helpers
+    uint32_t addVisibleTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3);
+    void resolveTile(int tileIndex, ShadingModel model, const Light& light,
+                     const Material& material, const glm::vec3& viewPos);
+    
     // Barycentric coordinate helper for interpolation
     glm::vec3 computeBarycentric(float x, float y, const glm::vec2& v1, 
                                  const glm::vec2& v2, const glm::vec2& v3);
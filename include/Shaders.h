@@ -3,6 +3,7 @@
 
 #include <glm/glm.hpp>
 #include "Rasterizer.h"
+#include "Simd.h"
 
 /**
  * @brief Light structure for shading calculations
@@ -39,6 +40,7 @@ struct Material {
  * - Gouraud Shading (per-vertex lighting, interpolated across triangle)
  * - Phong Shading (per-pixel lighting)
  * - Blinn-Phong reflection model
+ * - A 4-wide SIMD Phong path for per-pixel lighting at full resolution
  */
 class Shaders {
 public:
@@ -62,6 +64,23 @@ public:
         const Material& material         // Material properties
     );
     
+#ifdef LUMINA_SSE2
+    // Phong Shading for four fragments at once (SoA: one register per component)
+    // Same model as computePhongShading, with rsqrt normalization and fastPow4;
+    // writes the clamped colors in [0, 1], one register per channel
+    static void computePhongShading4(
+        const __m128 fragPos[3],         // Fragment positions (x, y, z lanes)
+        const __m128 normal[3],          // Interpolated normals (any length)
+        const glm::vec3& viewPos,        // Camera position
+        const Light& light,              // Light source
+        const Material& material,        // Material properties
+        __m128 rgb[3]                    // Output: red, green and blue lanes
+    );
+    
+    // Approximate pow(base, exponent) for base in [0, 1] (specular term)
+    static __m128 fastPow4(__m128 base, float exponent);
+#endif
+    
     // Helper function to interpolate colors (for Gouraud shading)
     static Color interpolateColor(const Color& c1, const Color& c2, float t);
     static Color interpolateColor(const Color& c1, const Color& c2, const Color& c3,
@@ -0,0 +1,26 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/**
+ * @brief Compile-time detection of the SIMD instruction sets used by the
+ * software pipeline
+ *
+ * LUMINA_SSE2 is defined when SSE2 intrinsics are available. SSE2 is part
+ * of the x86-64 baseline, so every 64-bit x86 build (GCC, Clang, MSVC) gets
+ * the vectorized kernels. Other targets fall back to the scalar loops.
+ *
+ * LUMINA_AVX2 is defined when the compiler targets AVX2 (-mavx2 or
+ * /arch:AVX2, see the LUMINA_ENABLE_AVX2 CMake option). The few 8-wide
+ * kernels use it; the SSE2 ones are used otherwise.
+ */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define LUMINA_SSE2 1
+#endif
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define LUMINA_AVX2 1
+#endif
+
+#endif // SIMD_H
@@ -0,0 +1,48 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed-size pool of worker threads for data-parallel loops
+ * 
+ * The pool keeps its threads alive for the lifetime of the object so that
+ * per-frame work (e.g. rasterizing screen tiles) does not pay for thread
+ * creation. The calling thread takes part in every parallelFor, so a pool
+ * created with N threads starts N - 1 workers.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(int threadCount);
+    ~ThreadPool();
+    
+    // Runs job(0) ... job(count - 1) across all threads and waits for completion
+    void parallelFor(int count, const std::function<void(int)>& job);
+    
+    // Total number of threads including the caller
+    int getThreadCount() const { return static_cast<int>(workers.size()) + 1; }
+    
+private:
+    std::vector<std::thread> workers;
+    
+    std::mutex mutex;
+    std::condition_variable wakeCondition;   // Signals a new batch of jobs
+    std::condition_variable doneCondition;   // Signals that all workers finished
+    
+    const std::function<void(int)>* currentJob;
+    int jobCount;
+    std::atomic<int> nextJob;
+    int activeWorkers;
+    unsigned int generation;                 // Incremented for every parallelFor
+    bool stopping;
+    
+    void workerLoop();
+    void runJobs();
+};
+
+#endif // THREADPOOL_H
@@ -13,7 +13,35 @@ enum ClipCode {
     LEFT = 1,    // 0001
     RIGHT = 2,   // 0010
     BOTTOM = 4,  // 0100
-    TOP = 8      // 1000
+    TOP = 8,     // 1000
+    
+    // Additional planes used by homogeneous triangle clipping
+    NEAR_PLANE = 16,
+    FAR_PLANE = 32
+};
+
+/**
+ * @brief Outcome of clipping a triangle in homogeneous clip space
+ */
+enum TriangleClipResult {
+    TRIANGLE_REJECTED = 0,  // Entirely outside the view frustum
+    TRIANGLE_ACCEPTED = 1,  // Inside the near/far planes and the guard band; draw as is
+    TRIANGLE_CLIPPED = 2    // Replaced by a convex polygon (see ClippedPolygon)
+};
+
+/**
+ * @brief Convex polygon produced by clipping a triangle
+ * 
+ * Each vertex carries its clip-space position and its barycentric weights
+ * with respect to the input triangle, so the caller can interpolate any
+ * vertex attribute (normals, colors, world positions) for the new vertices.
+ */
+struct ClippedPolygon {
+    static const int MAX_VERTICES = 9;  // 3 + one per clip plane
+    
+    int count;
+    glm::vec4 position[MAX_VERTICES];
+    glm::vec3 weights[MAX_VERTICES];
 };
 
 /**
@@ -22,6 +50,7 @@ enum ClipCode {
  * This class implements:
  * - Model, View, and Projection matrices using homogeneous coordinates
  * - Cohen-Sutherland line clipping algorithm
+ * - Sutherland-Hodgman triangle clipping in homogeneous clip space
  * - Viewport transformations
  * - Matrix stack operations
  */
@@ -49,6 +78,14 @@ public:
     glm::vec4 transformVertex(const glm::vec4& vertex) const;
     glm::vec3 transformNormal(const glm::vec3& normal) const;
     
+    // Batched vertex transform of count model-space points (x[i], y[i], z[i], 1)
+    // in structure-of-arrays layout. Writes clip-space positions (for
+    // clipTriangle()) and, in the same pass, screen positions (x, y, NDC z, 1/w)
+    // for a screenWidth x screenHeight viewport.
+    void transformVertices(const float* x, const float* y, const float* z, int count,
+                           int screenWidth, int screenHeight,
+                           glm::vec4* clipPositions, glm::vec4* screenPositions) const;
+    
     // Viewport transformation (NDC to screen coordinates)
     glm::vec2 viewportTransform(const glm::vec4& ndcCoord, int screenWidth, 
                                 int screenHeight) const;
@@ -57,13 +94,25 @@ public:
     bool clipLine(float& x1, float& y1, float& x2, float& y2, 
                   float xMin, float yMin, float xMax, float yMax);
     
+    // Sutherland-Hodgman Triangle Clipping (clip space, before perspective division).
+    // Only triangles crossing the near/far planes or the guard band are clipped.
+    TriangleClipResult clipTriangle(const glm::vec4& v1, const glm::vec4& v2, 
+                                    const glm::vec4& v3, ClippedPolygon& polygon) const;
+    void setGuardBand(float band) { guardBand = band; }
+    float getGuardBand() const { return guardBand; }
+    
     // Getters
     const glm::mat4& getModelMatrix() const { return modelMatrix; }
     const glm::mat4& getViewMatrix() const { return viewMatrix; }
     const glm::mat4& getProjectionMatrix() const { return projectionMatrix; }
-    glm::mat4 getMVPMatrix() const { return projectionMatrix * viewMatrix * modelMatrix; }
-    glm::mat4 getModelViewMatrix() const { return viewMatrix * modelMatrix; }
-    glm::mat3 getNormalMatrix() const;
+    
+    // Derived matrices, cached: computed on first use after a setter changed
+    // one of the matrices they depend on. (Not safe to call concurrently
+    // while a cached matrix is stale.)
+    const glm::mat4& getMVPMatrix() const;
+    const glm::mat4& getModelViewMatrix() const;
+    const glm::mat3& getNormalMatrix() const;       // View space normals
+    const glm::mat3& getModelNormalMatrix() const;  // World space normals
     
     // Matrix stack operations (useful for hierarchical transformations)
     void pushMatrix();
@@ -76,9 +125,29 @@ private:
     
     std::vector<glm::mat4> matrixStack;
     
+    // Cached derived matrices and which of them are stale
+    enum DerivedMatrix {
+        DERIVED_MVP = 1,            // projection * view * model
+        DERIVED_MODEL_VIEW = 2,     // view * model
+        DERIVED_NORMAL = 4,         // Inverse transpose of the model-view
+        DERIVED_MODEL_NORMAL = 8,   // Inverse transpose of the model
+        DERIVED_ALL = 15
+    };
+    mutable glm::mat4 mvpMatrix;
+    mutable glm::mat4 modelViewMatrix;
+    mutable glm::mat3 normalMatrix;
+    mutable glm::mat3 modelNormalMatrix;
+    mutable int staleMatrices;  // DerivedMatrix bits
+    
+    // Guard band half-extent in NDC units (1.0 = the viewport edges)
+    float guardBand;
+    
     // Helper for Cohen-Sutherland
     int computeOutCode(float x, float y, float xMin, float yMin, 
                       float xMax, float yMax) const;
+    
+    // Helper for triangle clipping: out code of a clip-space vertex
+    int computeClipCode(const glm::vec4& v, float band) const;
 };
 
 #endif // TRANSFORM_H
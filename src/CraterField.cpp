@@ -0,0 +1,222 @@
+#include "CraterField.h"
+#include <algorithm>
+#include <cmath>
+
+static const float PI = 3.14159265f;
+static const float TWO_PI = 6.28318531f;
+
+// Rim profile extends to this multiple of the bowl radius
+static const float INFLUENCE_SCALE = 1.3f;
+
+// Grid limits: cells are at least this many radians wide, at most this many per axis
+static const float MIN_CELL_SIZE = 0.005f;
+static const int MAX_CELLS_PER_AXIS = 1024;
+
+/**
+ * @brief splitmix64: small, seedable, and the same sequence on every platform
+ * (unlike the std:: distributions)
+ */
+static float nextRandom(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    return static_cast<float>(z >> 40) * (1.0f / 16777216.0f);  // [0, 1)
+}
+
+/**
+ * @brief Wraps an angle into [0, 2 pi)
+ */
+static float wrapPhi(float phi) {
+    phi -= TWO_PI * std::floor(phi / TWO_PI);
+    return phi < TWO_PI ? phi : 0.0f;
+}
+
+/**
+ * @brief Creates an empty field
+ */
+CraterField::CraterField()
+    : cellsTheta(1), cellsPhi(1), cellsPerRadianTheta(0.0f), cellsPerRadianPhi(0.0f) {
+    cellStart.assign(2, 0);
+}
+
+/**
+ * @brief Scatters count craters over the sphere and indexes them
+ * 
+ * Centers are uniform in area (theta = acos(1 - 2u)), radii follow a
+ * power law truncated to [minRadius, maxRadius], sampled by inverting its
+ * CDF, and the depth is 0.375 to 0.5 of the radius like fresh lunar
+ * craters. The same seed always gives the same field.
+ * 
+ * The grid cell size follows the crater density, but not below the
+ * influence diameter of the smallest craters: each sample then checks
+ * about one crater per cell plus those overlapping it, so the cost per
+ * sample depends on how densely craters overlap, not on their number.
+ */
+void CraterField::generate(uint32_t seed, int count, float minRadius, float maxRadius,
+                           float exponent) {
+    count = std::max(count, 0);
+    minRadius = std::max(minRadius, 1e-4f);
+    maxRadius = std::max(maxRadius, minRadius);
+    
+    craters.clear();
+    craters.reserve(count);
+    uint64_t state = seed;
+    float tail = 1.0f - std::pow(minRadius / maxRadius, exponent);
+    
+    for (int i = 0; i < count; ++i) {
+        Crater crater;
+        crater.theta = std::acos(1.0f - 2.0f * nextRandom(state));
+        crater.phi = TWO_PI * nextRandom(state);
+        crater.radius = minRadius * std::pow(1.0f - nextRandom(state) * tail, -1.0f / exponent);
+        crater.depth = crater.radius * (0.375f + 0.125f * nextRandom(state));
+        craters.push_back(crater);
+    }
+    
+    float cellSize = 2.0f * INFLUENCE_SCALE * minRadius;
+    if (count > 0) {
+        cellSize = std::max(cellSize, std::sqrt(2.0f * PI * PI / count));
+    }
+    buildIndex(cellSize);
+}
+
+/**
+ * @brief Calls visit(cell) for every grid cell that the crater's area of
+ * influence overlaps
+ * 
+ * The influence is a spherical cap of angular radius R around the center.
+ * Away from the poles it spans theta +- R and phi +- asin(sin R / sin theta);
+ * a cap containing a pole covers all of phi.
+ */
+template <typename Visit>
+void CraterField::forEachCell(const Crater& crater, Visit visit) const {
+    // Small margin so that float rounding cannot drop a cell on the border
+    float influence = crater.radius * INFLUENCE_SCALE * 1.001f + 1e-5f;
+    
+    float thetaMin = crater.theta - influence;
+    float thetaMax = crater.theta + influence;
+    int t0 = std::max(static_cast<int>(std::floor(thetaMin * cellsPerRadianTheta)), 0);
+    int t1 = std::min(static_cast<int>(std::floor(thetaMax * cellsPerRadianTheta)), cellsTheta - 1);
+    
+    int p0 = 0;
+    int p1 = cellsPhi - 1;
+    bool fullRing = thetaMin <= 0.0f || thetaMax >= PI;
+    if (!fullRing) {
+        float sinRatio = std::sin(influence) / std::sin(crater.theta);
+        fullRing = sinRatio >= 1.0f;
+        if (!fullRing) {
+            float halfWidth = std::asin(sinRatio);
+            p0 = static_cast<int>(std::floor((crater.phi - halfWidth) * cellsPerRadianPhi));
+            p1 = static_cast<int>(std::floor((crater.phi + halfWidth) * cellsPerRadianPhi));
+            fullRing = p1 - p0 + 1 >= cellsPhi;
+        }
+    }
+    if (fullRing) {
+        p0 = 0;
+        p1 = cellsPhi - 1;
+    }
+    
+    for (int t = t0; t <= t1; ++t) {
+        for (int p = p0; p <= p1; ++p) {
+            int wrapped = ((p % cellsPhi) + cellsPhi) % cellsPhi;
+            visit(t * cellsPhi + wrapped);
+        }
+    }
+}
+
+/**
+ * @brief Precomputes the per crater sampling values and bins the craters
+ * into the grid (counting pass, prefix sum, fill pass)
+ */
+void CraterField::buildIndex(float cellSize) {
+    cellSize = std::max(cellSize, MIN_CELL_SIZE);
+    cellsTheta = std::min(std::max(static_cast<int>(std::ceil(PI / cellSize)), 1),
+                          MAX_CELLS_PER_AXIS);
+    cellsPhi = std::min(std::max(static_cast<int>(std::ceil(TWO_PI / cellSize)), 1),
+                        MAX_CELLS_PER_AXIS);
+    cellsPerRadianTheta = cellsTheta / PI;
+    cellsPerRadianPhi = cellsPhi / TWO_PI;
+    
+    samples.resize(craters.size());
+    for (size_t i = 0; i < craters.size(); ++i) {
+        const Crater& crater = craters[i];
+        CraterSample& sample = samples[i];
+        sample.x = std::sin(crater.theta) * std::cos(crater.phi);
+        sample.y = std::cos(crater.theta);
+        sample.z = std::sin(crater.theta) * std::sin(crater.phi);
+        sample.inverseRadius = 1.0f / crater.radius;
+        sample.depth = crater.depth;
+        float influence = std::min(crater.radius * INFLUENCE_SCALE, PI);
+        float chord = 2.0f * std::sin(0.5f * influence);
+        sample.influenceChord2 = chord * chord;
+    }
+    
+    int cellCount = cellsTheta * cellsPhi;
+    cellStart.assign(cellCount + 1, 0);
+    for (const Crater& crater : craters) {
+        forEachCell(crater, [this](int cell) { ++cellStart[cell + 1]; });
+    }
+    for (int cell = 0; cell < cellCount; ++cell) {
+        cellStart[cell + 1] += cellStart[cell];
+    }
+    
+    cellCraters.resize(cellStart[cellCount]);
+    std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+    for (size_t i = 0; i < craters.size(); ++i) {
+        forEachCell(craters[i], [&](int cell) {
+            cellCraters[fill[cell]++] = static_cast<uint32_t>(i);
+        });
+    }
+}
+
+/**
+ * @brief Evaluates the crater profiles at (theta, phi)
+ * 
+ * Only the craters listed in the sample's grid cell are visited. The chord
+ * between the unit vectors rejects craters out of reach without
+ * trigonometry; the angle 2 asin(chord / 2) is computed for the rest.
+ * Inside the bowl the profile is a cosine with a slightly flattened floor,
+ * and a Gaussian rim rises around the edge.
+ */
+float CraterField::displacement(float theta, float phi) const {
+    theta = std::min(std::max(theta, 0.0f), PI);
+    phi = wrapPhi(phi);
+    
+    int t = std::min(static_cast<int>(theta * cellsPerRadianTheta), cellsTheta - 1);
+    int p = std::min(static_cast<int>(phi * cellsPerRadianPhi), cellsPhi - 1);
+    int cell = t * cellsPhi + p;
+    
+    float sinTheta = std::sin(theta);
+    float x = sinTheta * std::cos(phi);
+    float y = std::cos(theta);
+    float z = sinTheta * std::sin(phi);
+    
+    float displacement = 0.0f;
+    for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; ++i) {
+        const CraterSample& crater = samples[cellCraters[i]];
+        float dx = x - crater.x;
+        float dy = y - crater.y;
+        float dz = z - crater.z;
+        float chord2 = dx * dx + dy * dy + dz * dz;
+        if (chord2 >= crater.influenceChord2) continue;
+    
+        float dist = 2.0f * std::asin(std::min(0.5f * std::sqrt(chord2), 1.0f));
+        float normalized = dist * crater.inverseRadius;
+    
+        if (normalized <= 1.0f) {
+            // Inside crater: bowl shape with flat floor
+            float bowlProfile = crater.depth * (0.5f * std::cos(normalized * PI) + 0.5f);
+            // Flatten the center slightly for realism
+            float flattenFactor = 1.0f - 0.3f * std::exp(-normalized * normalized * 8.0f);
+            displacement -= bowlProfile * flattenFactor;
+        }
+    
+        // Raised crater rim
+        if (normalized > 0.75f) {
+            float rimDist = normalized - 1.0f;
+            displacement += crater.depth * 0.35f * std::exp(-rimDist * rimDist * 25.0f);
+        }
+    }
+    
+    return displacement;
+}
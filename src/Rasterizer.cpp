@@ -1,18 +1,99 @@
 #include "Rasterizer.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include "Shaders.h"
+#include "PixelShaders.h"
+#include "DepthFormats.h"
 #include <algorithm>
+#include <cfloat>
 #include <cmath>
 #include <cstring>
+#include <type_traits>
+
+// 4x MSAA sample positions relative to the pixel center, in 1/16 pixel (the
+// 28.4 fixed-point grid, so sample edge values stay exact). A rotated grid:
+// no two samples share a row or a column.
+static const int MSAA_SAMPLE_OFFSETS[Rasterizer::MSAA_SAMPLES][2] = {
+    {-2, -6}, {6, -2}, {-6, 2}, {2, 6}
+};
+static const int MSAA_SAMPLE_RADIUS = 6;  // Largest offset along either axis
+
+// Triangles per job of a sort-last flush
+static const int SORT_LAST_BATCH = 256;
+
+/**
+ * @brief Atomic minimum of a (depth key << 32 | payload) word
+ * 
+ * Equal depths are settled by the smaller payload, so the result does not
+ * depend on which thread gets there first.
+ * 
+ * @return true if the word was lowered
+ */
+static inline bool atomicMinWord(std::atomic<uint64_t>& target, uint64_t value) {
+    uint64_t old = target.load(std::memory_order_relaxed);
+    while (value < old) {
+        if (target.compare_exchange_weak(old, value, std::memory_order_relaxed)) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Atomic minimum of the depth key of a word, keeping its payload (depth-only writes)
+ */
+static inline bool atomicMinDepth(std::atomic<uint64_t>& target, uint32_t key) {
+    uint64_t old = target.load(std::memory_order_relaxed);
+    while (key < (old >> 32)) {
+        uint64_t value = (static_cast<uint64_t>(key) << 32) | (old & 0xFFFFFFFFu);
+        if (target.compare_exchange_weak(old, value, std::memory_order_relaxed)) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Depth range transform: vertex NDC z in [-1, 1] to buffer depth in [0, 1]
+ * 
+ * Every depth format, hierarchical Z and the sort-last keys work on [0, 1]
+ * (1 = far plane, the cleared value), so the unorm formats spend their
+ * whole range on the view volume.
+ */
+static inline float windowDepth(float ndcZ) {
+    return ndcZ * 0.5f + 0.5f;
+}
 
 /**
  * @brief Constructor - Initializes frame buffer and depth buffer
  */
 Rasterizer::Rasterizer(int width, int height) 
-    : width(width), height(height) {
-    // Allocate frame buffer (RGB format: 3 bytes per pixel)
-    frameBuffer = new uint8_t[width * height * 3];
+    : width(width), height(height), pixelFormat(PIXEL_RGBA8), depthFormat(DEPTH_FLOAT32), 
+      depthTest(DEPTH_TEST_LESS), rasterMode(RASTER_EDGE_FUNCTION), 
+      cullMode(CULL_NONE), culledTriangles(0), smallTriangleSize(MAX_SMALL_TRIANGLE_SIZE),
+      emptySmallTriangles(0), shadingModel(SHADING_GOURAUD),
+      shaderUniforms(new ShaderUniforms()), 
+      hierarchicalZ(true), visibilityBuffer(false), primitiveBuffer(nullptr), 
+      depthPrepass(false), prepassTriangles(0), prepassOwners(false), equalPassTriangles(0), 
+      multisampling(false), sampleColors(nullptr), sampleDepths(nullptr), 
+      parallelMode(PARALLEL_TILE_BINNING), packedBuffer(nullptr), threadPool(nullptr) {
+    // One triangle bin per screen tile
+    tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    tileBins.resize(tilesX * tilesY);
+    tileStates.assign(tilesX * tilesY, TILE_STALE);
+    presentedClear.assign(tilesX * tilesY, 0);
+    packedTiles.assign(tilesX * tilesY, 0);
+    
+    // Render targets are tiled (see pixelIndex()) and padded to whole tiles
+    bufferSize = tilesX * tilesY * TILE_SIZE * TILE_SIZE;
+    colorBuffer = new uint32_t[bufferSize];
+    depthBuffer = new uint8_t[bufferSize * sizeof(float)];  // Room for any depth format
     
-    // Allocate depth buffer (1 float per pixel)
-    depthBuffer = new float[width * height];
+    // Presented frame buffer (row-major), large enough for either pixel format
+    frameBuffer = new uint8_t[width * height * 4];
+    
+    // Hierarchical Z: farthest depth per 8x8 block and per tile
+    blocksX = (width + 7) / 8;
+    blocksY = (height + 7) / 8;
+    blockMaxDepth.resize(blocksX * blocksY);
+    tileMaxDepth.resize(tilesX * tilesY);
     
     // Initialize buffers
     clearBuffers();
@@ -22,25 +103,394 @@ Rasterizer::Rasterizer(int width, int height)
  * @brief Destructor - Cleans up allocated memory
  */
 Rasterizer::~Rasterizer() {
+    delete threadPool;
+    delete shaderUniforms;
+    delete[] primitiveBuffer;
+    delete[] sampleColors;
+    delete[] sampleDepths;
+    delete[] packedBuffer;
     delete[] frameBuffer;
+    delete[] colorBuffer;
     delete[] depthBuffer;
 }
 
 /**
  * @brief Clears both frame buffer and depth buffer
+ * 
+ * The clear is lazy: it only marks every tile as stale. A stale tile's
+ * color, depth and primitive IDs are reset when a triangle or pixel first
+ * touches it, so tiles nothing draws to cost no memory traffic at all,
+ * which for a mostly empty scene is most of the screen. The presented frame
+ * buffer only gets the clear color where it does not already show it.
+ * 
+ * Triangles still waiting in the tile bins, triangles kept for the
+ * visibility buffer and the visible set of the last depth prepass are
+ * discarded.
  */
 void Rasterizer::clearBuffers(const Color& clearColor) {
-    // Clear frame buffer with specified color
-    for (int i = 0; i < width * height; ++i) {
-        frameBuffer[i * 3 + 0] = clearColor.r;
-        frameBuffer[i * 3 + 1] = clearColor.g;
-        frameBuffer[i * 3 + 2] = clearColor.b;
+    binnedTriangles.clear();
+    for (std::vector<uint32_t>& bin : tileBins) {
+        bin.clear();
+    }
+    std::fill(packedTiles.begin(), packedTiles.end(), 0);
+    
+    bool sameColor = clearColor.r == bufferClearColor.r && clearColor.g == bufferClearColor.g &&
+                     clearColor.b == bufferClearColor.b && clearColor.a == bufferClearColor.a;
+    bufferClearColor = clearColor;
+    std::fill(tileStates.begin(), tileStates.end(), static_cast<uint8_t>(TILE_STALE));
+    if (!sameColor) {
+        std::fill(presentedClear.begin(), presentedClear.end(), 0);
+    }
+    
+    std::fill(blockMaxDepth.begin(), blockMaxDepth.end(), 1.0f);
+    std::fill(tileMaxDepth.begin(), tileMaxDepth.end(), 1.0f);
+    visibleTriangles.clear();
+    prepassVisible.clear();
+    prepassOwners = false;
+    culledTriangles = 0;
+    std::fill(triangleSizeHistogram, triangleSizeHistogram + SIZE_HISTOGRAM_BUCKETS, 0);
+    emptySmallTriangles = 0;
+}
+
+/**
+ * @brief Returns the presented (row-major) frame buffer
+ * 
+ * Completes pending rasterization, then copies every tile drawn to since
+ * the last clear out of the tiled render target (averaging the samples with
+ * MSAA), and fills tiles nothing was drawn to with the clear color.
+ */
+uint8_t* Rasterizer::getFrameBuffer() {
+    flush();
+    
+    if (threadPool) {
+        threadPool->parallelFor(tilesX * tilesY, [this](int tileIndex) {
+            presentTile(tileIndex);
+        });
+    } else {
+        for (int tileIndex = 0; tileIndex < tilesX * tilesY; ++tileIndex) {
+            presentTile(tileIndex);
+        }
+    }
+    return frameBuffer;
+}
+
+/**
+ * @brief Writes one tile of the presented frame buffer
+ */
+void Rasterizer::presentTile(int tileIndex) {
+    if (tileStates[tileIndex] == TILE_DRAWN) {
+        if (multisampleActive()) {
+            resolveSampleTile(tileIndex);
+        } else {
+            linearizeTile(tileIndex);
+        }
+        presentedClear[tileIndex] = 0;
+    } else if (!presentedClear[tileIndex]) {
+        presentClearTile(tileIndex);
+        presentedClear[tileIndex] = 1;
+    }
+}
+
+/**
+ * @brief Copies one tile of the tiled color buffer to the row-major frame buffer
+ * 
+ * Every row of a tile is a run of 8-pixel block rows, each contiguous in the
+ * tiled buffer, so in PIXEL_RGBA8 format a block row moves with two 16-byte
+ * loads and stores.
+ */
+void Rasterizer::linearizeTile(int tileIndex) {
+    int tileX = (tileIndex % tilesX) * TILE_SIZE;
+    int tileY = (tileIndex / tilesX) * TILE_SIZE;
+    int tileMaxX = std::min(tileX + TILE_SIZE, width);
+    int tileMaxY = std::min(tileY + TILE_SIZE, height);
+    
+    for (int y = tileY; y < tileMaxY; ++y) {
+        for (int x = tileX; x < tileMaxX; x += 8) {
+            const uint32_t* in = colorBuffer + pixelIndex(x, y);
+            int count = std::min(8, tileMaxX - x);
+            int index = y * width + x;
+            
+            if (pixelFormat == PIXEL_RGBA8) {
+                uint32_t* out = reinterpret_cast<uint32_t*>(frameBuffer) + index;
+#ifdef LUMINA_SSE2
+                if (count == 8) {
+                    const __m128i* source = reinterpret_cast<const __m128i*>(in);
+                    __m128i* target = reinterpret_cast<__m128i*>(out);
+                    _mm_storeu_si128(target, _mm_loadu_si128(source));
+                    _mm_storeu_si128(target + 1, _mm_loadu_si128(source + 1));
+                    continue;
+                }
+#endif
+                std::memcpy(out, in, count * sizeof(uint32_t));
+            } else {
+                uint8_t* out = frameBuffer + index * 3;
+                for (int i = 0; i < count; ++i) {
+                    out[i * 3 + 0] = static_cast<uint8_t>(in[i]);
+                    out[i * 3 + 1] = static_cast<uint8_t>(in[i] >> 8);
+                    out[i * 3 + 2] = static_cast<uint8_t>(in[i] >> 16);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Fills one tile of the presented frame buffer with the clear color
+ */
+void Rasterizer::presentClearTile(int tileIndex) {
+    const Color& clearColor = bufferClearColor;
+    int tileX = (tileIndex % tilesX) * TILE_SIZE;
+    int tileY = (tileIndex / tilesX) * TILE_SIZE;
+    int tileMaxX = std::min(tileX + TILE_SIZE, width);
+    int tileMaxY = std::min(tileY + TILE_SIZE, height);
+    
+    for (int y = tileY; y < tileMaxY; ++y) {
+        int index = y * width + tileX;
+        int count = tileMaxX - tileX;
+        
+        if (pixelFormat == PIXEL_RGBA8) {
+            uint32_t* pixels = reinterpret_cast<uint32_t*>(frameBuffer) + index;
+            std::fill(pixels, pixels + count, packClearColor());
+        } else {
+            uint8_t* pixel = frameBuffer + index * 3;
+            for (int i = 0; i < count; ++i) {
+                pixel[i * 3 + 0] = clearColor.r;
+                pixel[i * 3 + 1] = clearColor.g;
+                pixel[i * 3 + 2] = clearColor.b;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Resets color, depth and primitive IDs of one tile to the clear values
+ * 
+ * A tile is one contiguous range of the tiled buffers.
+ */
+void Rasterizer::clearTile(int tileIndex) {
+    clearSpan(tileIndex * TILE_SIZE * TILE_SIZE, TILE_SIZE * TILE_SIZE);
+}
+
+/**
+ * @brief Clears count consecutive pixels of the tiled buffers
+ * 
+ * Color is filled with a 16-byte store per four pixels, depth with the far
+ * plane value of the current format.
+ */
+void Rasterizer::clearSpan(int index, int count) {
+    uint32_t packed = packClearColor();
+    int end = index + count;
+    
+    int i = index;
+#ifdef LUMINA_SSE2
+    const __m128i colorFill = _mm_set1_epi32(static_cast<int>(packed));
+    for (; i + 3 < end; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(colorBuffer + i), colorFill);
+    }
+#endif
+    for (; i < end; ++i) {
+        colorBuffer[i] = packed;
+    }
+    fillDepth(depthBuffer, index, count);
+    
+    // Clear primitive IDs while some pass reads them; the buffer stays
+    // allocated after the visibility buffer or a prepass is switched off
+    if (primitiveBuffer && (visibilityBuffer || depthPrepass || prepassOwners)) {
+        std::fill(primitiveBuffer + index, primitiveBuffer + end, NO_PRIMITIVE);
+    }
+    
+    // Clear the MSAA sample planes
+    if (multisampleActive()) {
+        for (int s = 0; s < MSAA_SAMPLES; ++s) {
+            int plane = s * bufferSize;
+            std::fill(sampleColors + plane + index, sampleColors + plane + end, packed);
+            fillDepth(sampleDepths, plane + index, count);
+        }
+    }
+}
+
+/**
+ * @brief The clear color packed as R | G << 8 | B << 16 | A << 24
+ */
+uint32_t Rasterizer::packClearColor() const {
+    const Color& clearColor = bufferClearColor;
+    return static_cast<uint32_t>(clearColor.r) | (static_cast<uint32_t>(clearColor.g) << 8) |
+           (static_cast<uint32_t>(clearColor.b) << 16) | (static_cast<uint32_t>(clearColor.a) << 24);
+}
+
+/**
+ * @brief Depth test (and store on pass) of one stored depth in format Format
+ */
+template <typename Format>
+static bool testDepthAs(uint8_t* buffer, int index, float depth, DepthTest test) {
+    typename Format::Type& stored = reinterpret_cast<typename Format::Type*>(buffer)[index];
+    return test == DEPTH_TEST_EQUAL ? DepthEqual<Format>::test(stored, depth) 
+                                    : Format::test(stored, depth);
+}
+
+/**
+ * @brief Depth test of one pixel or sample in the current depth format
+ * 
+ * @return True if the depth passed (and, for DEPTH_TEST_LESS, was stored)
+ */
+bool Rasterizer::testDepth(uint8_t* buffer, int index, float depth) {
+    switch (depthFormat) {
+        case DEPTH_UNORM16: return testDepthAs<DepthUnorm16>(buffer, index, depth, depthTest);
+        case DEPTH_UNORM24: return testDepthAs<DepthUnorm24>(buffer, index, depth, depthTest);
+        default:            return testDepthAs<DepthFloat32>(buffer, index, depth, depthTest);
+    }
+}
+
+/**
+ * @brief Resets count consecutive depths in format Depth to the far plane
+ */
+template <typename Depth>
+static void fillDepthAs(uint8_t* buffer, int index, int count) {
+    typename Depth::Type* depth = reinterpret_cast<typename Depth::Type*>(buffer) + index;
+    std::fill(depth, depth + count, Depth::FAR_VALUE);
+}
+
+/**
+ * @brief Resets count consecutive depths in the current format to the far plane
+ */
+void Rasterizer::fillDepth(uint8_t* buffer, int index, int count) {
+    switch (depthFormat) {
+        case DEPTH_UNORM16: fillDepthAs<DepthUnorm16>(buffer, index, count); break;
+        case DEPTH_UNORM24: fillDepthAs<DepthUnorm24>(buffer, index, count); break;
+        default:            fillDepthAs<DepthFloat32>(buffer, index, count); break;
+    }
+}
+
+/**
+ * @brief Marks every tile stale and resets hierarchical Z
+ * 
+ * Used when the buffers a tile is drawn to change (MSAA, visibility
+ * buffer), so that every tile is cleared again in the new configuration on
+ * first use.
+ */
+void Rasterizer::invalidateTiles() {
+    std::fill(tileStates.begin(), tileStates.end(), static_cast<uint8_t>(TILE_STALE));
+    std::fill(blockMaxDepth.begin(), blockMaxDepth.end(), 1.0f);
+    std::fill(tileMaxDepth.begin(), tileMaxDepth.end(), 1.0f);
+}
+
+/**
+ * @brief Selects the layout of the presented frame buffer
+ * 
+ * Rendering always uses the internal tiled RGBA target; the format only
+ * changes what getFrameBuffer() writes. PIXEL_RGBA8 matches the internal
+ * pixels, so presenting is a plain 16-byte copy per four pixels.
+ */
+void Rasterizer::setPixelFormat(PixelFormat format) {
+    flush();
+    pixelFormat = format;
+    std::fill(presentedClear.begin(), presentedClear.end(), 0);
+}
+
+/**
+ * @brief Selects the depth buffer format
+ * 
+ * The buffers are sized for 4-byte depths, so switching only reinterprets
+ * them; every tile is cleared again in the new format on first use.
+ * DEPTH_UNORM16 halves the depth traffic of the fill loop and of
+ * hierarchical Z updates.
+ */
+void Rasterizer::setDepthFormat(DepthFormat format) {
+    flush();
+    if (format == depthFormat) return;
+    depthFormat = format;
+    invalidateTiles();
+}
+
+/**
+ * @brief Selects the depth comparison of the fill loops
+ * 
+ * DEPTH_TEST_EQUAL is meant for the shading pass after a depth prepass:
+ * each pixel is then shaded only by the surface that is visible there.
+ * Hierarchical Z does not reject anything in this mode, as the depths it
+ * stores would also reject the pixels at exactly the farthest depth.
+ */
+void Rasterizer::setDepthTest(DepthTest test) {
+    flush();
+    depthTest = test;
+    prepassOwners = false;
+}
+
+/**
+ * @brief Allocates the triangle ID buffer on first use, or resets the IDs
+ * of the tiles already drawn this frame
+ * 
+ * Tiles that are not drawn yet get their IDs cleared with the rest of the
+ * tile (see clearSpan()).
+ */
+void Rasterizer::resetPrimitiveIds() {
+    if (!primitiveBuffer) {
+        primitiveBuffer = new uint32_t[bufferSize];
+        std::fill(primitiveBuffer, primitiveBuffer + bufferSize, NO_PRIMITIVE);
+        return;
+    }
+    
+    const int tilePixels = TILE_SIZE * TILE_SIZE;
+    for (int t = 0; t < tilesX * tilesY; ++t) {
+        if (tileStates[t] == TILE_DRAWN) {
+            std::fill(primitiveBuffer + t * tilePixels, 
+                      primitiveBuffer + (t + 1) * tilePixels, NO_PRIMITIVE);
+        }
+    }
+}
+
+/**
+ * @brief Starts a depth prepass (see endDepthPrepass())
+ * 
+ * IDs left in the tiles already drawn this frame are reset, so that only
+ * this prepass's triangles are found by endDepthPrepass().
+ */
+void Rasterizer::beginDepthPrepass() {
+    flush();
+    resetPrimitiveIds();
+    
+    depthPrepass = true;
+    depthTest = DEPTH_TEST_LESS;
+    prepassOwners = false;
+    prepassTriangles = 0;
+    prepassVisible.clear();
+}
+
+/**
+ * @brief Completes the depth prepass and selects DEPTH_TEST_EQUAL
+ * 
+ * A triangle is visible if its index survived in the ID buffer of a drawn
+ * tile. Triangles that lost every pixel to nearer ones are fully hidden, so
+ * the Z-equal pass drops them before their vertices are even set up. The
+ * others replace the depth comparison with the ID test: a pixel is shaded
+ * only by the triangle that owns it, which also settles two triangles that
+ * store the same depth there. Without per-pixel IDs (MSAA keeps depth per
+ * sample only) every triangle is reported visible and depths are compared.
+ */
+void Rasterizer::endDepthPrepass() {
+    flush();
+    depthPrepass = false;
+    depthTest = DEPTH_TEST_EQUAL;
+    equalPassTriangles = 0;
+    
+    if (visibilityBuffer || multisampleActive() || rasterMode != RASTER_EDGE_FUNCTION) {
+        prepassVisible.assign(prepassTriangles, 1);
+        return;
     }
     
-    // Clear depth buffer with maximum depth (far plane)
-    for (int i = 0; i < width * height; ++i) {
-        depthBuffer[i] = 1.0f;  // 1.0 = far plane in normalized coordinates
+    prepassVisible.assign(prepassTriangles, 0);
+    const int tilePixels = TILE_SIZE * TILE_SIZE;
+    for (int t = 0; t < tilesX * tilesY; ++t) {
+        if (tileStates[t] != TILE_DRAWN) continue;
+        
+        const uint32_t* ids = primitiveBuffer + t * tilePixels;
+        for (int i = 0; i < tilePixels; ++i) {
+            if (ids[i] < prepassTriangles) {
+                prepassVisible[ids[i]] = 1;
+            }
+        }
     }
+    prepassOwners = true;
 }
 
 /**
@@ -53,6 +503,8 @@ void Rasterizer::clearBuffers(const Color& clearColor) {
  * Space Complexity: O(1)
  */
 void Rasterizer::draw_line(int x1, int y1, int x2, int y2, const Color& color) {
+    flush();
+    
     // Determine if the line is steep (more vertical than horizontal)
     if (std::abs(y2 - y1) < std::abs(x2 - x1)) {
         // Line is more horizontal
@@ -138,6 +590,8 @@ void Rasterizer::drawLineHigh(int x1, int y1, int x2, int y2, const Color& color
  * Space Complexity: O(1)
  */
 void Rasterizer::draw_circle(int xc, int yc, int r, const Color& color) {
+    flush();
+    
     int x = 0;
     int y = r;
     
@@ -183,23 +637,43 @@ void Rasterizer::drawCirclePoints(int xc, int yc, int x, int y, const Color& col
 /**
  * @brief Draws a filled triangle with shading
  * 
- * This method implements scanline rasterization with Z-buffering.
+ * In RASTER_SCANLINE mode this implements scanline rasterization with Z-buffering.
  * It splits the triangle into flat-top and flat-bottom triangles for easier processing.
+ * In RASTER_EDGE_FUNCTION mode the triangle is set up once and either
+ * rasterized immediately or binned for the tile threads (see flush()).
  * 
  * @param useGouraud If true, uses Gouraud shading (vertex colors interpolated)
  *                   If false, uses flat shading
  */
 void Rasterizer::drawTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3, 
                              bool useGouraud) {
-    // Sort vertices by y-coordinate (v1.y <= v2.y <= v3.y)
-    std::vector<Vertex> verts = {v1, v2, v3};
-    std::sort(verts.begin(), verts.end(), [](const Vertex& a, const Vertex& b) {
-        return a.position.y < b.position.y;
-    });
+    if (depthPrepass) ++prepassTriangles;
+    if (depthTest == DEPTH_TEST_EQUAL && !isPrepassTriangleVisible(equalPassTriangles++)) return;
+    if (cullTriangle(v1.position, v2.position, v3.position)) return;
+    
+    if (rasterMode == RASTER_EDGE_FUNCTION) {
+        submitTriangle(v1, v2, v3, useGouraud);
+    } else {
+        drawScanlineTriangle(v1, v2, v3, useGouraud);
+    }
+}
+
+/**
+ * @brief Scanline rasterization of one triangle that passed culling
+ */
+void Rasterizer::drawScanlineTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3, 
+                                      bool useGouraud) {
+    flush();
+    
+    // Sort vertices by y-coordinate (top.y <= mid.y <= bot.y)
+    const Vertex* sorted[3] = {&v1, &v2, &v3};
+    if (sorted[1]->position.y < sorted[0]->position.y) std::swap(sorted[0], sorted[1]);
+    if (sorted[2]->position.y < sorted[1]->position.y) std::swap(sorted[1], sorted[2]);
+    if (sorted[1]->position.y < sorted[0]->position.y) std::swap(sorted[0], sorted[1]);
     
-    const Vertex& top = verts[0];
-    const Vertex& mid = verts[1];
-    const Vertex& bot = verts[2];
+    const Vertex& top = *sorted[0];
+    const Vertex& mid = *sorted[1];
+    const Vertex& bot = *sorted[2];
     
     // Check for degenerate triangle
     if (top.position.y == bot.position.y) return;
@@ -232,6 +706,154 @@ void Rasterizer::drawTriangle(const Vertex& v1, const Vertex& v2, const Vertex&
     }
 }
 
+/**
+ * @brief Draws indexCount / 3 triangles from shared vertex and index arrays
+ * 
+ * Vertices are in screen space, as for drawTriangle(). Every three indices
+ * form one triangle. In edge function mode the whole batch is set up and
+ * binned in one loop without going through drawTriangle() per triangle.
+ * The tile bins and per-frame triangle arrays keep their capacity across
+ * clearBuffers(), so once they have grown to the scene's size submitting a
+ * frame performs no heap allocation.
+ * 
+ * @param alreadyCulled If true, the caller has culled the batch with
+ *                      cullTriangle() and no triangle is tested again
+ */
+void Rasterizer::drawIndexed(const Vertex* vertices, const uint32_t* indices, int indexCount,
+                             bool useGouraud, bool alreadyCulled) {
+    int triangleCount = indexCount / 3;
+    
+    for (int i = 0; i < triangleCount; ++i) {
+        const Vertex& v1 = vertices[indices[i * 3 + 0]];
+        const Vertex& v2 = vertices[indices[i * 3 + 1]];
+        const Vertex& v3 = vertices[indices[i * 3 + 2]];
+        if (depthPrepass) ++prepassTriangles;
+        if (depthTest == DEPTH_TEST_EQUAL && !isPrepassTriangleVisible(equalPassTriangles++)) {
+            continue;
+        }
+        if (!alreadyCulled && cullTriangle(v1.position, v2.position, v3.position)) continue;
+        
+        if (rasterMode == RASTER_EDGE_FUNCTION) {
+            submitTriangle(v1, v2, v3, useGouraud);
+        } else {
+            drawScanlineTriangle(v1, v2, v3, useGouraud);
+        }
+    }
+}
+
+/**
+ * @brief Face culling from the screen-space signed area
+ * 
+ * Screen y grows downward, so a triangle that is counter-clockwise (front
+ * facing) in NDC has a negative signed area on screen. Zero-area triangles
+ * cover no pixels and are always culled. Culled triangles are counted.
+ * 
+ * The area is taken from the positions snapped to the 28.4 grid, exactly as
+ * setupTriangle() will see them: a sliver whose winding flips when snapped
+ * would otherwise be culled by one test and kept by the other, leaving
+ * sub-pixel cracks between front faces (visible as dark MSAA samples).
+ * 
+ * @param p1, p2, p3 Screen-space positions (only x and y are used)
+ * @return true if the triangle must not be drawn
+ */
+bool Rasterizer::cullTriangle(const glm::vec4& p1, const glm::vec4& p2, const glm::vec4& p3) {
+    const float limit = static_cast<float>(MAX_SCREEN_COORD);
+    const float SUBPIXEL_SCALE = static_cast<float>(1 << SUBPIXEL_BITS);
+    
+    int64_t area = 0;
+    if (std::abs(p1.x) < limit && std::abs(p1.y) < limit && std::abs(p2.x) < limit && 
+        std::abs(p2.y) < limit && std::abs(p3.x) < limit && std::abs(p3.y) < limit) {
+        int64_t x1 = std::lround(p1.x * SUBPIXEL_SCALE), y1 = std::lround(p1.y * SUBPIXEL_SCALE);
+        int64_t x2 = std::lround(p2.x * SUBPIXEL_SCALE), y2 = std::lround(p2.y * SUBPIXEL_SCALE);
+        int64_t x3 = std::lround(p3.x * SUBPIXEL_SCALE), y3 = std::lround(p3.y * SUBPIXEL_SCALE);
+        area = (x2 - x1) * (y3 - y1) - (y2 - y1) * (x3 - x1);
+    } else {
+        // Out of fixed-point range (setup rejects it anyway): float orientation
+        float floatArea = (p2.x - p1.x) * (p3.y - p1.y) - (p2.y - p1.y) * (p3.x - p1.x);
+        area = (floatArea > 0.0f) - (floatArea < 0.0f);
+    }
+    
+    bool culled = area == 0 || 
+                  (cullMode == CULL_BACK && area > 0) || 
+                  (cullMode == CULL_FRONT && area < 0);
+    if (culled) {
+        ++culledTriangles;
+    }
+    return culled;
+}
+
+/**
+ * @brief Sets the largest bounding box side handled by the small-triangle path
+ * 
+ * @param pixels 0 disables the path; clamped to MAX_SMALL_TRIANGLE_SIZE
+ */
+void Rasterizer::setSmallTriangleSize(int pixels) {
+    smallTriangleSize = std::min(std::max(pixels, 0), static_cast<int>(MAX_SMALL_TRIANGLE_SIZE));
+}
+
+/**
+ * @brief Selects the pixel shading of the edge function rasterizer
+ * 
+ * Applies to triangles submitted afterwards; triangles already binned keep
+ * the shading they were submitted with.
+ */
+void Rasterizer::setShadingModel(ShadingModel model) {
+    shadingModel = model;
+}
+
+/**
+ * @brief Sets the lighting used by per-pixel (Phong) shading
+ * 
+ * Binned triangles are shaded when flushed, so they are flushed first with
+ * the previous lighting.
+ */
+void Rasterizer::setShaderUniforms(const Light& light, const Material& material,
+                                   const glm::vec3& viewPos) {
+    flush();
+    shaderUniforms->light = light;
+    shaderUniforms->material = material;
+    shaderUniforms->viewPos = viewPos;
+}
+
+/**
+ * @brief Sets up one triangle for the edge function rasterizer and bins it
+ * (or rasterizes it immediately when running single-threaded)
+ * 
+ * The pixel shader is chosen here, once per triangle: the visibility buffer
+ * and the depth prepass write triangle IDs, otherwise the shading model
+ * applies (Gouraud falls back to flat when useGouraud is false).
+ */
+void Rasterizer::submitTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3,
+                                bool useGouraud) {
+    int shader = PIXEL_SHADER_GOURAUD;
+    if (visibilityBuffer || depthPrepass) {
+        shader = PIXEL_SHADER_PRIMITIVE_ID;
+    } else if (shadingModel == SHADING_PHONG) {
+        shader = PIXEL_SHADER_PHONG;
+    } else if (shadingModel == SHADING_DEPTH_ONLY) {
+        shader = PIXEL_SHADER_DEPTH_ONLY;
+    } else if (shadingModel == SHADING_FLAT || !useGouraud) {
+        shader = PIXEL_SHADER_FLAT;
+    }
+    
+    TriangleSetup tri;
+    if (!setupTriangle(v1, v2, v3, shader, tri)) return;
+    
+    if (visibilityBuffer) {
+        tri.primitiveId = addVisibleTriangle(v1, v2, v3);
+    } else if (depthPrepass) {
+        tri.primitiveId = prepassTriangles - 1;
+    } else if (prepassOwners) {
+        tri.primitiveId = equalPassTriangles - 1;
+    }
+    
+    if (threadPool) {
+        binTriangle(tri);
+    } else {
+        rasterizeTriangle(tri, 0, 0, width - 1, height - 1);
+    }
+}
+
 /**
  * @brief Fills a flat-bottom triangle using scanline rasterization
  */
@@ -260,7 +882,8 @@ void Rasterizer::fillFlatBottomTriangle(const Vertex& v1, const Vertex& v2,
             );
             
             // Interpolate depth
-            float depth = bary.x * v1.position.z + bary.y * v2.position.z + bary.z * v3.position.z;
+            float depth = windowDepth(bary.x * v1.position.z + bary.y * v2.position.z + 
+                                      bary.z * v3.position.z);
             
             // Interpolate color
             Color color(
@@ -303,7 +926,8 @@ void Rasterizer::fillFlatTopTriangle(const Vertex& v1, const Vertex& v2,
                 glm::vec2(v3.position.x, v3.position.y)
             );
             
-            float depth = bary.x * v1.position.z + bary.y * v2.position.z + bary.z * v3.position.z;
+            float depth = windowDepth(bary.x * v1.position.z + bary.y * v2.position.z + 
+                                      bary.z * v3.position.z);
             
             Color color(
                 static_cast<uint8_t>(bary.x * v1.color.r + bary.y * v2.color.r + bary.z * v3.color.r),
@@ -320,74 +944,1740 @@ void Rasterizer::fillFlatTopTriangle(const Vertex& v1, const Vertex& v2,
 }
 
 /**
- * @brief Draws a wireframe triangle
- */
-void Rasterizer::drawWireframeTriangle(const Vertex& v1, const Vertex& v2, 
-                                      const Vertex& v3, const Color& color) {
-    int x1 = static_cast<int>(v1.position.x);
-    int y1 = static_cast<int>(v1.position.y);
-    int x2 = static_cast<int>(v2.position.x);
-    int y2 = static_cast<int>(v2.position.y);
-    int x3 = static_cast<int>(v3.position.x);
-    int y3 = static_cast<int>(v3.position.y);
-    
-    draw_line(x1, y1, x2, y2, color);
-    draw_line(x2, y2, x3, y3, color);
-    draw_line(x3, y3, x1, y1, color);
-}
-
-/**
- * @brief Computes barycentric coordinates for point (x,y) in triangle (v1,v2,v3)
+ * @brief Sets up a triangle for edge function (half-space) rasterization
  * 
- * Barycentric coordinates allow us to interpolate values across a triangle.
- * They represent the weights of each vertex for a point inside the triangle.
+ * Vertex positions are snapped to 28.4 fixed point (1/16 pixel). Each edge
+ * (a, b) then defines an exact integer function E(x, y) that is positive on
+ * the inside of the triangle, evaluated at pixel centers. Pixels exactly on
+ * an edge follow the top-left rule: they belong to the triangle only if the
+ * edge is a top edge (horizontal, interior below) or a left edge (interior
+ * to its right). This is folded into the edge value as a -1 bias for all
+ * other edges, so coverage is simply E >= 0 and a pixel on an edge shared by
+ * two triangles is drawn by exactly one of them.
+ * 
+ * Depth and color are set up once per triangle as plane equations
+ * f(x, y) = f0 + dfdx * (x - x0) + dfdy * (y - y0) from the snapped
+ * positions. The only division is the reciprocal of the triangle area.
+ * 
+ * Triangles whose bounding box fits the small-triangle size record which
+ * pixel centers they cover (tri.coverage) and are rejected here if none.
+ * 
+ * @return false if the triangle is degenerate, entirely off screen, has a
+ *         vertex beyond MAX_SCREEN_COORD or is small and covers no pixel
  */
-glm::vec3 Rasterizer::computeBarycentric(float x, float y, const glm::vec2& v1, 
-                                         const glm::vec2& v2, const glm::vec2& v3) {
-    float denominator = (v2.y - v3.y) * (v1.x - v3.x) + (v3.x - v2.x) * (v1.y - v3.y);
+bool Rasterizer::setupTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3,
+                               int shader, TriangleSetup& tri) {
+    const Vertex* p0 = &v1;
+    const Vertex* p1 = &v2;
+    const Vertex* p2 = &v3;
     
-    if (std::abs(denominator) < 1e-6f) {
-        return glm::vec3(1.0f / 3.0f);  // Degenerate triangle
+    // Fixed-point range check (also rejects NaN/inf from the perspective divide)
+    const float limit = static_cast<float>(MAX_SCREEN_COORD);
+    for (const Vertex* v : {p0, p1, p2}) {
+        if (!(std::abs(v->position.x) < limit && std::abs(v->position.y) < limit)) {
+            return false;
+        }
     }
     
-    float w1 = ((v2.y - v3.y) * (x - v3.x) + (v3.x - v2.x) * (y - v3.y)) / denominator;
-    float w2 = ((v3.y - v1.y) * (x - v3.x) + (v1.x - v3.x) * (y - v3.y)) / denominator;
-    float w3 = 1.0f - w1 - w2;
+    // Snap to 28.4 fixed point
+    const float SUBPIXEL_SCALE = static_cast<float>(1 << SUBPIXEL_BITS);
+    int64_t X[3], Y[3];
+    X[0] = std::lround(p0->position.x * SUBPIXEL_SCALE);
+    Y[0] = std::lround(p0->position.y * SUBPIXEL_SCALE);
+    X[1] = std::lround(p1->position.x * SUBPIXEL_SCALE);
+    Y[1] = std::lround(p1->position.y * SUBPIXEL_SCALE);
+    X[2] = std::lround(p2->position.x * SUBPIXEL_SCALE);
+    Y[2] = std::lround(p2->position.y * SUBPIXEL_SCALE);
     
-    return glm::vec3(w1, w2, w3);
-}
-
-/**
- * @brief Sets a pixel in the frame buffer
- */
-void Rasterizer::setPixel(int x, int y, const Color& color) {
-    if (!isInBounds(x, y)) return;
+    // Twice the signed area (exact); flip winding so the inside is always positive
+    int64_t area = (X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]);
+    if (area == 0) return false;  // Degenerate triangle
+    if (area < 0) {
+        std::swap(p1, p2);
+        std::swap(X[1], X[2]);
+        std::swap(Y[1], Y[2]);
+        area = -area;
+    }
     
-    int index = (y * width + x) * 3;
-    frameBuffer[index + 0] = color.r;
-    frameBuffer[index + 1] = color.g;
-    frameBuffer[index + 2] = color.b;
-}
-
-/**
- * @brief Sets a pixel with Z-buffer depth testing
- * 
- * This implements the Z-buffer algorithm for hidden surface removal.
- * Only draws the pixel if it's closer to the camera than the current depth value.
- */
+    // Bounding box of the pixels whose center (16 * x + 8), or with MSAA any
+    // of whose samples, lies inside the triangle's extent
+    const int64_t HALF = 1 << (SUBPIXEL_BITS - 1);
+    const int64_t ROUND = (1 << SUBPIXEL_BITS) - 1;
+    const int64_t radius = multisampleActive() ? MSAA_SAMPLE_RADIUS : 0;
+    int64_t minXf = std::min({X[0], X[1], X[2]});
+    int64_t minYf = std::min({Y[0], Y[1], Y[2]});
+    int64_t maxXf = std::max({X[0], X[1], X[2]});
+    int64_t maxYf = std::max({Y[0], Y[1], Y[2]});
+    
+    tri.minX = static_cast<int>(std::max<int64_t>(0, (minXf - HALF - radius + ROUND) >> SUBPIXEL_BITS));
+    tri.minY = static_cast<int>(std::max<int64_t>(0, (minYf - HALF - radius + ROUND) >> SUBPIXEL_BITS));
+    tri.maxX = static_cast<int>(std::min<int64_t>(width - 1, (maxXf - HALF + radius) >> SUBPIXEL_BITS));
+    tri.maxY = static_cast<int>(std::min<int64_t>(height - 1, (maxYf - HALF + radius) >> SUBPIXEL_BITS));
+    if (tri.minX > tri.maxX || tri.minY > tri.maxY) return false;
+    
+    int boxWidth = tri.maxX - tri.minX + 1;
+    int boxHeight = tri.maxY - tri.minY + 1;
+    int bucket = 0;
+    while (bucket < SIZE_HISTOGRAM_BUCKETS - 1 && std::max(boxWidth, boxHeight) > (1 << bucket)) {
+        ++bucket;
+    }
+    ++triangleSizeHistogram[bucket];
+    
+    // Edge k is opposite vertex k and runs from vertex a to vertex b:
+    // E(P) = (Ya - Yb) * (Px - Xa) + (Xb - Xa) * (Py - Ya)
+    int64_t pixelX = (static_cast<int64_t>(tri.minX) << SUBPIXEL_BITS) + HALF;
+    int64_t pixelY = (static_cast<int64_t>(tri.minY) << SUBPIXEL_BITS) + HALF;
+    
+    for (int k = 0; k < 3; ++k) {
+        int ia = (k + 1) % 3;
+        int ib = (k + 2) % 3;
+        int64_t dy = Y[ia] - Y[ib];
+        int64_t dx = X[ib] - X[ia];
+        
+        // Top-left rule: left edges rise to the right (dy > 0), top edges are
+        // horizontal with the interior below (dy == 0, dx > 0)
+        bool topLeft = dy > 0 || (dy == 0 && dx > 0);
+        
+        tri.A[k] = static_cast<int32_t>(dy << SUBPIXEL_BITS);  // Step per pixel in x
+        tri.B[k] = static_cast<int32_t>(dx << SUBPIXEL_BITS);  // Step per pixel in y
+        tri.E0[k] = dy * (pixelX - X[ia]) + dx * (pixelY - Y[ia]) - (topLeft ? 0 : 1);
+    }
+    
+    // Small triangles: test the few candidate pixel centers right away; most
+    // micro triangles cover none and need no attribute setup at all
+    tri.coverage = 0;
+    if (boxWidth <= smallTriangleSize && boxHeight <= smallTriangleSize && !multisampleActive()) {
+        for (int y = 0; y < boxHeight; ++y) {
+            for (int x = 0; x < boxWidth; ++x) {
+                bool covered = true;
+                for (int k = 0; k < 3; ++k) {
+                    if (tri.E0[k] + static_cast<int64_t>(tri.A[k]) * x + 
+                        static_cast<int64_t>(tri.B[k]) * y < 0) {
+                        covered = false;
+                    }
+                }
+                if (covered) {
+                    tri.coverage |= uint64_t(1) << (y * MAX_SMALL_TRIANGLE_SIZE + x);
+                }
+            }
+        }
+        if (!tri.coverage) {
+            ++emptySmallTriangles;
+            return false;
+        }
+    }
+    
+    // Plane equations, anchored at (snapped) vertex 0
+    const float INV_SCALE = 1.0f / SUBPIXEL_SCALE;
+    tri.refX = X[0] * INV_SCALE;
+    tri.refY = Y[0] * INV_SCALE;
+    
+    float ax = tri.refX,     ay = tri.refY;
+    float bx = X[1] * INV_SCALE, by = Y[1] * INV_SCALE;
+    float cx = X[2] * INV_SCALE, cy = Y[2] * INV_SCALE;
+    float invArea = 1.0f / ((bx - ax) * (cy - ay) - (by - ay) * (cx - ax));
+    
+    auto plane = [&](float f0, float f1, float f2) {
+        AttributePlane result;
+        result.value = f0;
+        result.ddx = (f0 * (by - cy) + f1 * (cy - ay) + f2 * (ay - by)) * invArea;
+        result.ddy = (f0 * (cx - bx) + f1 * (ax - cx) + f2 * (bx - ax)) * invArea;
+        return result;
+    };
+    
+    // NDC depth is already affine in screen space, and so is its [0, 1] mapping
+    float z[3] = {windowDepth(p0->position.z), windowDepth(p1->position.z), 
+                  windowDepth(p2->position.z)};
+    tri.depth = plane(z[0], z[1], z[2]);
+    tri.minZ = std::min({z[0], z[1], z[2]});
+    
+    // 1/w is affine in screen space, and so is any attribute divided by w
+    float invW[3] = {p0->position.w, p1->position.w, p2->position.w};
+    if (!(invW[0] > 0.0f && invW[1] > 0.0f && invW[2] > 0.0f)) {
+        invW[0] = invW[1] = invW[2] = 1.0f;  // No perspective information: affine
+    }
+    tri.invW = plane(invW[0], invW[1], invW[2]);
+    
+    // Vertex stage of the pixel shader: varyings and flat constants
+    // (the provoking vertex is the first one submitted)
+    const Vertex* const vertices[3] = {p0, p1, p2};
+    float varyings[3][MAX_VARYINGS];
+    int varyingCount = 0;
+    
+    tri.shader = shader;
+    switch (shader) {
+        case PIXEL_SHADER_FLAT:
+            varyingCount = setupShaderInputs<FlatShader>(vertices, varyings, tri.constants);
+            break;
+        case PIXEL_SHADER_GOURAUD:
+            varyingCount = setupShaderInputs<GouraudShader>(vertices, varyings, tri.constants);
+            break;
+        case PIXEL_SHADER_PHONG:
+            varyingCount = setupShaderInputs<PhongShader>(vertices, varyings, tri.constants);
+            break;
+        case PIXEL_SHADER_DEPTH_ONLY:
+            varyingCount = setupShaderInputs<DepthOnlyShader>(vertices, varyings, tri.constants);
+            break;
+        default:
+            varyingCount = setupShaderInputs<PrimitiveIdShader>(vertices, varyings, tri.constants);
+            break;
+    }
+    
+    for (int k = 0; k < varyingCount; ++k) {
+        tri.varyings[k] = plane(varyings[0][k] * invW[0], varyings[1][k] * invW[1], 
+                                varyings[2][k] * invW[2]);
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Runs a pixel shader's vertex stage on the three vertices of a triangle
+ * 
+ * @return The shader's number of varyings
+ */
+template <typename Shader>
+int Rasterizer::setupShaderInputs(const Vertex* const vertices[3], 
+                                  float varyings[3][MAX_VARYINGS], float* constants) {
+    static_assert(Shader::VARYING_COUNT <= MAX_VARYINGS, "Too many varyings");
+    
+    Shader::constants(*vertices[0], constants);
+    for (int i = 0; i < 3; ++i) {
+        Shader::varyings(*vertices[i], varyings[i]);
+    }
+    return Shader::VARYING_COUNT;
+}
+
+/**
+ * @brief Rasterizes a set-up triangle inside a clip rectangle
+ * 
+ * The bounding box (intersected with the clip rectangle) is walked in 8x8
+ * blocks: blocks whose four corners lie outside one edge are skipped, blocks
+ * fully inside all three edges skip the per-pixel coverage test. Blocks are
+ * aligned to the block grid, so a tile-sized clip rectangle never splits one.
+ * 
+ * With hierarchical Z enabled the triangle is first tested against the
+ * farthest depth stored in the tiles it touches, then every block against
+ * its own farthest depth, so occluded geometry is rejected before any
+ * per-pixel work.
+ * 
+ * Pixels are sampled at their centers (x + 0.5, y + 0.5), or with MSAA at
+ * the four sample positions around them; the block tests then widen every
+ * edge and the depth bound by the sample radius.
+ * 
+ * The Z-equal test writes no depth, so hierarchical Z is neither used nor
+ * updated with it.
+ */
+void Rasterizer::rasterizeTriangle(const TriangleSetup& tri, int clipMinX, int clipMinY,
+                                   int clipMaxX, int clipMaxY) {
+    const int BLOCK_SIZE = 8;
+    const bool useHiZ = hierarchicalZ && depthTest == DEPTH_TEST_LESS;
+    
+    int minX = std::max(tri.minX, clipMinX);
+    int minY = std::max(tri.minY, clipMinY);
+    int maxX = std::min(tri.maxX, clipMaxX);
+    int maxY = std::min(tri.maxY, clipMaxY);
+    if (minX > maxX || minY > maxY) return;
+    
+    int tileMinX = minX / TILE_SIZE;
+    int tileMinY = minY / TILE_SIZE;
+    int tileMaxX = maxX / TILE_SIZE;
+    int tileMaxY = maxY / TILE_SIZE;
+    
+    if (useHiZ) {
+        // Whole-triangle rejection: nearest vertex behind every touched tile
+        float farthest = -FLT_MAX;
+        for (int ty = tileMinY; ty <= tileMaxY; ++ty) {
+            for (int tx = tileMinX; tx <= tileMaxX; ++tx) {
+                farthest = std::max(farthest, tileMaxDepth[ty * tilesX + tx]);
+            }
+        }
+        if (tri.minZ >= farthest) return;
+    }
+    
+    if (tri.coverage) {
+        if (rasterizeSmallTriangle(tri, minX, minY, maxX, maxY) && useHiZ) {
+            for (int ty = tileMinY; ty <= tileMaxY; ++ty) {
+                for (int tx = tileMinX; tx <= tileMaxX; ++tx) {
+                    updateTileMaxDepth(ty * tilesX + tx);
+                }
+            }
+        }
+        return;
+    }
+    
+    // Sort-last: tiles are prepared and hierarchical Z rebuilt by flushSortLast()
+    const bool sortLast = sortLastActive();
+    
+    // Samples lie up to sampleRadius sub-pixels from the pixel centers
+    const int sampleRadius = multisampleActive() ? MSAA_SAMPLE_RADIUS : 0;
+    
+    // Offsets from a block's first pixel center to its nearest depth corner
+    float nearestOffsetX = std::min(0.0f, tri.depth.ddx * (BLOCK_SIZE - 1));
+    float nearestOffsetY = std::min(0.0f, tri.depth.ddy * (BLOCK_SIZE - 1));
+    float sampleDepthMargin = (std::abs(tri.depth.ddx) + std::abs(tri.depth.ddy)) * 
+                              sampleRadius / (1 << SUBPIXEL_BITS);
+    bool anyWritten = false;
+    
+    // Walk the bounding box in blocks aligned to the block grid
+    int blockMinX = minX & ~(BLOCK_SIZE - 1);
+    int blockMinY = minY & ~(BLOCK_SIZE - 1);
+    
+    for (int by = blockMinY; by <= maxY; by += BLOCK_SIZE) {
+        for (int bx = blockMinX; bx <= maxX; bx += BLOCK_SIZE) {
+            // Trivial reject / accept using the edge values at the four corner
+            // pixels (exact 64-bit integers), widened by the sample radius
+            bool outside = false;
+            int partialEdges = 0;
+            int32_t blockE[3];
+            
+            for (int k = 0; k < 3; ++k) {
+                int64_t e00 = tri.E0[k] + static_cast<int64_t>(tri.A[k]) * (bx - tri.minX) + 
+                              static_cast<int64_t>(tri.B[k]) * (by - tri.minY);
+                int64_t e10 = e00 + static_cast<int64_t>(tri.A[k]) * (BLOCK_SIZE - 1);
+                int64_t e01 = e00 + static_cast<int64_t>(tri.B[k]) * (BLOCK_SIZE - 1);
+                int64_t e11 = e10 + static_cast<int64_t>(tri.B[k]) * (BLOCK_SIZE - 1);
+                int64_t margin = static_cast<int64_t>(std::abs(tri.A[k] >> SUBPIXEL_BITS) + 
+                                                      std::abs(tri.B[k] >> SUBPIXEL_BITS)) * 
+                                 sampleRadius;
+                
+                if (std::max({e00, e10, e01, e11}) + margin < 0) {
+                    outside = true;
+                    break;
+                }
+                if (std::min({e00, e10, e01, e11}) - margin < 0) {
+                    // The edge crosses the block, so |e00| is bounded by the
+                    // block's extent along the edge and fits in 32 bits
+                    partialEdges |= 1 << k;
+                    blockE[k] = static_cast<int32_t>(e00);
+                } else {
+                    blockE[k] = 0;
+                }
+            }
+            if (outside) continue;
+            
+            int blockIndex = (by / BLOCK_SIZE) * blocksX + bx / BLOCK_SIZE;
+            
+            if (useHiZ) {
+                // The plane's minimum over the block is at a corner; the triangle
+                // itself never gets nearer than its nearest vertex
+                float nearest = tri.depth.at(bx + 0.5f - tri.refX, by + 0.5f - tri.refY) + 
+                                nearestOffsetX + nearestOffsetY - sampleDepthMargin;
+                nearest = std::max(nearest, tri.minZ);
+                if (nearest >= blockMaxDepth[blockIndex]) continue;
+            }
+            
+            // Clip the block against the bounding box
+            int startX = std::max(bx, minX);
+            int startY = std::max(by, minY);
+            int endX = std::min(bx + BLOCK_SIZE - 1, maxX);
+            int endY = std::min(by + BLOCK_SIZE - 1, maxY);
+            
+            if (!sortLast) {
+                prepareTile((by / TILE_SIZE) * tilesX + bx / TILE_SIZE);
+            }
+            bool written = fillBlock(tri, bx, by, blockE, partialEdges, 
+                                     startX, startY, endX, endY);
+            
+            if (written && useHiZ && !sortLast) {
+                updateBlockMaxDepth(blockIndex);
+                anyWritten = true;
+            }
+        }
+    }
+    
+    if (anyWritten) {
+        for (int ty = tileMinY; ty <= tileMaxY; ++ty) {
+            for (int tx = tileMinX; tx <= tileMaxX; ++tx) {
+                updateTileMaxDepth(ty * tilesX + tx);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Rasterizes a small triangle inside the clipped box (minX, minY) - (maxX, maxY)
+ * 
+ * The box spans at most 2x2 blocks. Blocks holding none of the covered pixel
+ * centers found by setupTriangle() are skipped; the others go straight to
+ * the fill loop with every edge tested per pixel, without the corner
+ * classification or the depth-plane bound of the general path.
+ * 
+ * @return true if any pixel was written
+ */
+bool Rasterizer::rasterizeSmallTriangle(const TriangleSetup& tri, int minX, int minY, 
+                                        int maxX, int maxY) {
+    const int BLOCK_SIZE = 8;
+    const int ALL_EDGES = 7;
+    const bool sortLast = sortLastActive();
+    const bool useHiZ = hierarchicalZ && depthTest == DEPTH_TEST_LESS;
+    bool anyWritten = false;
+    
+    for (int by = minY & ~(BLOCK_SIZE - 1); by <= maxY; by += BLOCK_SIZE) {
+        for (int bx = minX & ~(BLOCK_SIZE - 1); bx <= maxX; bx += BLOCK_SIZE) {
+            int startX = std::max(bx, minX);
+            int startY = std::max(by, minY);
+            int endX = std::min(bx + BLOCK_SIZE - 1, maxX);
+            int endY = std::min(by + BLOCK_SIZE - 1, maxY);
+            
+            // Coverage bits of the part of the box inside this block
+            uint64_t rowBits = ((uint64_t(1) << (endX - startX + 1)) - 1) << (startX - tri.minX);
+            uint64_t region = 0;
+            for (int y = startY; y <= endY; ++y) {
+                region |= rowBits << ((y - tri.minY) * MAX_SMALL_TRIANGLE_SIZE);
+            }
+            if (!(tri.coverage & region)) continue;
+            
+            int blockIndex = (by / BLOCK_SIZE) * blocksX + bx / BLOCK_SIZE;
+            if (useHiZ && tri.minZ >= blockMaxDepth[blockIndex]) continue;
+            
+            // The block is within a box of 8 pixels, so edge values fit in 32 bits
+            int32_t blockE[3];
+            for (int k = 0; k < 3; ++k) {
+                blockE[k] = static_cast<int32_t>(
+                    tri.E0[k] + static_cast<int64_t>(tri.A[k]) * (bx - tri.minX) + 
+                    static_cast<int64_t>(tri.B[k]) * (by - tri.minY));
+            }
+            
+            if (!sortLast) {
+                prepareTile((by / TILE_SIZE) * tilesX + bx / TILE_SIZE);
+            }
+            if (fillBlock(tri, bx, by, blockE, ALL_EDGES, startX, startY, endX, endY) && 
+                useHiZ && !sortLast) {
+                updateBlockMaxDepth(blockIndex);
+                anyWritten = true;
+            }
+        }
+    }
+    return anyWritten;
+}
+
+/**
+ * @brief Recomputes the farthest depth stored in one 8x8 block
+ */
+void Rasterizer::updateBlockMaxDepth(int blockIndex) {
+    switch (depthFormat) {
+        case DEPTH_UNORM16:
+            blockMaxDepth[blockIndex] = farthestDepthInBlock<DepthUnorm16>(blockIndex);
+            break;
+        case DEPTH_UNORM24:
+            blockMaxDepth[blockIndex] = farthestDepthInBlock<DepthUnorm24>(blockIndex);
+            break;
+        default:
+            blockMaxDepth[blockIndex] = farthestDepthInBlock<DepthFloat32>(blockIndex);
+            break;
+    }
+}
+
+/**
+ * @brief Farthest depth stored in one 8x8 block, in format Depth
+ * 
+ * With MSAA the farthest depth is taken over every sample plane. Each block
+ * row is 8 contiguous depths; float rows are reduced with SSE2.
+ */
+template <typename Depth>
+float Rasterizer::farthestDepthInBlock(int blockIndex) const {
+    typedef typename Depth::Type Type;
+    const int BLOCK_SIZE = 8;
+    int startX = (blockIndex % blocksX) * BLOCK_SIZE;
+    int startY = (blockIndex / blocksX) * BLOCK_SIZE;
+    int endX = std::min(startX + BLOCK_SIZE, width);
+    int endY = std::min(startY + BLOCK_SIZE, height);
+    
+    bool multisampled = multisampleActive();
+    int planes = multisampled ? MSAA_SAMPLES : 1;
+    Type farthest = Depth::NEAR_VALUE;
+    
+    for (int s = 0; s < planes; ++s) {
+        const Type* depth = multisampled 
+            ? reinterpret_cast<const Type*>(sampleDepths) + s * bufferSize 
+            : reinterpret_cast<const Type*>(depthBuffer);
+        
+#ifdef LUMINA_SSE2
+        if constexpr (std::is_same<Depth, DepthFloat32>::value) {
+            if (endX - startX == BLOCK_SIZE) {
+                __m128 farthest4 = _mm_set1_ps(farthest);
+                for (int y = startY; y < endY; ++y) {
+                    const float* row = depth + pixelIndex(startX, y);
+                    farthest4 = _mm_max_ps(farthest4, _mm_max_ps(_mm_loadu_ps(row), 
+                                                                 _mm_loadu_ps(row + 4)));
+                }
+                // Horizontal max of the four lanes
+                farthest4 = _mm_max_ps(farthest4, _mm_shuffle_ps(farthest4, farthest4, 
+                                                                 _MM_SHUFFLE(1, 0, 3, 2)));
+                farthest4 = _mm_max_ps(farthest4, _mm_shuffle_ps(farthest4, farthest4, 
+                                                                 _MM_SHUFFLE(2, 3, 0, 1)));
+                farthest = _mm_cvtss_f32(farthest4);
+                continue;
+            }
+        }
+#endif
+        
+        for (int y = startY; y < endY; ++y) {
+            const Type* row = depth + pixelIndex(startX, y);
+            for (int x = 0; x < endX - startX; ++x) {
+                farthest = std::max(farthest, row[x]);
+            }
+        }
+    }
+    return Depth::decode(farthest);
+}
+
+/**
+ * @brief Recomputes a tile's farthest depth from its blocks
+ */
+void Rasterizer::updateTileMaxDepth(int tileIndex) {
+    const int BLOCKS_PER_TILE = TILE_SIZE / 8;
+    int startX = (tileIndex % tilesX) * BLOCKS_PER_TILE;
+    int startY = (tileIndex / tilesX) * BLOCKS_PER_TILE;
+    int endX = std::min(startX + BLOCKS_PER_TILE, blocksX);
+    int endY = std::min(startY + BLOCKS_PER_TILE, blocksY);
+    
+    float farthest = -FLT_MAX;
+    for (int y = startY; y < endY; ++y) {
+        for (int x = startX; x < endX; ++x) {
+            farthest = std::max(farthest, blockMaxDepth[y * blocksX + x]);
+        }
+    }
+    tileMaxDepth[tileIndex] = farthest;
+}
+
+/**
+ * @brief Adds a set-up triangle to the bin of every tile its bounding box touches
+ * (sort-last: marks those tiles)
+ */
+void Rasterizer::binTriangle(const TriangleSetup& tri) {
+    uint32_t triangleIndex = static_cast<uint32_t>(binnedTriangles.size());
+    binnedTriangles.push_back(tri);
+    
+    int tileMinX = tri.minX / TILE_SIZE;
+    int tileMinY = tri.minY / TILE_SIZE;
+    int tileMaxX = tri.maxX / TILE_SIZE;
+    int tileMaxY = tri.maxY / TILE_SIZE;
+    
+    // Sort-last keeps no per-tile lists, only which tiles are touched at all
+    bool sortLast = sortLastActive();
+    for (int ty = tileMinY; ty <= tileMaxY; ++ty) {
+        for (int tx = tileMinX; tx <= tileMaxX; ++tx) {
+            if (sortLast) {
+                packedTiles[ty * tilesX + tx] = 1;
+            } else {
+                tileBins[ty * tilesX + tx].push_back(triangleIndex);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Rasterizes every triangle binned to one tile, in submission order
+ * 
+ * The tile's pixels are only ever touched by the thread running this
+ * function, so no synchronization is needed on the frame or depth buffer.
+ */
+void Rasterizer::rasterizeTile(int tileIndex) {
+    int tileX = (tileIndex % tilesX) * TILE_SIZE;
+    int tileY = (tileIndex / tilesX) * TILE_SIZE;
+    int tileMaxX = std::min(tileX + TILE_SIZE, width) - 1;
+    int tileMaxY = std::min(tileY + TILE_SIZE, height) - 1;
+    
+    for (uint32_t triangleIndex : tileBins[tileIndex]) {
+        rasterizeTriangle(binnedTriangles[triangleIndex], tileX, tileY, tileMaxX, tileMaxY);
+    }
+}
+
+/**
+ * @brief Sets the number of rasterizer threads
+ * 
+ * With more than one thread, edge function triangles are binned into
+ * TILE_SIZE x TILE_SIZE screen tiles and rasterized in parallel by flush().
+ * With one thread they are rasterized immediately.
+ * 
+ * @param count Thread count; 0 uses the number of hardware threads
+ */
+void Rasterizer::setThreadCount(int count) {
+    flush();
+    
+    if (count <= 0) {
+        count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    
+    delete threadPool;
+    threadPool = (count > 1) ? new ThreadPool(count) : nullptr;
+}
+
+/**
+ * @brief Returns the number of rasterizer threads including the caller
+ */
+int Rasterizer::getThreadCount() const {
+    return threadPool ? threadPool->getThreadCount() : 1;
+}
+
+/**
+ * @brief Rasterizes all binned triangles, one tile per job
+ * 
+ * Must be called before the frame buffer is read. Line, circle and scanline
+ * drawing flush first so that draw order is preserved.
+ */
+void Rasterizer::flush() {
+    if (binnedTriangles.empty()) return;
+    
+    if (sortLastActive()) {
+        flushSortLast();
+    } else {
+        threadPool->parallelFor(tilesX * tilesY, [this](int tileIndex) {
+            rasterizeTile(tileIndex);
+        });
+    }
+    
+    binnedTriangles.clear();
+    for (std::vector<uint32_t>& bin : tileBins) {
+        bin.clear();
+    }
+}
+
+/**
+ * @brief Selects how flush() distributes triangles over the threads
+ * 
+ * The packed sort-last buffer is allocated on first use.
+ */
+void Rasterizer::setParallelMode(ParallelMode mode) {
+    flush();
+    parallelMode = mode;
+    
+    if (mode == PARALLEL_SORT_LAST && !packedBuffer) {
+        packedBuffer = new std::atomic<uint64_t>[bufferSize];
+    }
+}
+
+/**
+ * @brief Rasterizes all pending triangles sort-last
+ * 
+ * Three parallel passes, with no per-tile triangle lists and no ordering
+ * between triangles:
+ * 1. Every touched tile is prepared (lazily cleared) and its depth and
+ *    color (triangle IDs in visibility buffer mode) packed into 64-bit words.
+ * 2. The triangles are split into batches of SORT_LAST_BATCH; any thread
+ *    rasterizes any batch over the whole screen, merging each pixel with an
+ *    atomic minimum on its word. Hierarchical Z is only read in this pass.
+ * 3. Every touched tile is unpacked back and its hierarchical Z rebuilt.
+ * 
+ * The depth keys are the active depth format's stored values (see
+ * DepthFormats.h), so the depth test is the binned one. Because equal
+ * depths are settled by the smaller color, the image does not depend on
+ * thread timing, but where triangles tie in depth it can differ from tile
+ * binning (which keeps the first one submitted).
+ */
+void Rasterizer::flushSortLast() {
+    const int tileCount = tilesX * tilesY;
+    
+    threadPool->parallelFor(tileCount, [this](int tileIndex) {
+        if (!packedTiles[tileIndex]) return;
+        prepareTile(tileIndex);
+        switch (depthFormat) {
+            case DEPTH_UNORM16: packTile<DepthUnorm16>(tileIndex); break;
+            case DEPTH_UNORM24: packTile<DepthUnorm24>(tileIndex); break;
+            default:            packTile<DepthFloat32>(tileIndex); break;
+        }
+    });
+    
+    int triangleCount = static_cast<int>(binnedTriangles.size());
+    int batchCount = (triangleCount + SORT_LAST_BATCH - 1) / SORT_LAST_BATCH;
+    threadPool->parallelFor(batchCount, [this, triangleCount](int batch) {
+        int end = std::min((batch + 1) * SORT_LAST_BATCH, triangleCount);
+        for (int i = batch * SORT_LAST_BATCH; i < end; ++i) {
+            rasterizeTriangle(binnedTriangles[i], 0, 0, width - 1, height - 1);
+        }
+    });
+    
+    threadPool->parallelFor(tileCount, [this](int tileIndex) {
+        if (!packedTiles[tileIndex]) return;
+        switch (depthFormat) {
+            case DEPTH_UNORM16: unpackTile<DepthUnorm16>(tileIndex); break;
+            case DEPTH_UNORM24: unpackTile<DepthUnorm24>(tileIndex); break;
+            default:            unpackTile<DepthFloat32>(tileIndex); break;
+        }
+        packedTiles[tileIndex] = 0;
+    });
+}
+
+/**
+ * @brief Packs one tile's depth and color (or triangle ID) into packedBuffer
+ */
+template <typename Depth>
+void Rasterizer::packTile(int tileIndex) {
+    const int begin = tileIndex * TILE_SIZE * TILE_SIZE;
+    const int end = begin + TILE_SIZE * TILE_SIZE;
+    const typename Depth::Type* depth = reinterpret_cast<const typename Depth::Type*>(depthBuffer);
+    const uint32_t* payload = visibilityBuffer ? primitiveBuffer : colorBuffer;
+    
+    for (int i = begin; i < end; ++i) {
+        uint64_t key = Depth::sortKey(depth[i]);
+        packedBuffer[i].store((key << 32) | payload[i], std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Unpacks one tile of packedBuffer into the depth and color (or
+ * triangle ID) buffers and rebuilds its hierarchical Z
+ */
+template <typename Depth>
+void Rasterizer::unpackTile(int tileIndex) {
+    const int begin = tileIndex * TILE_SIZE * TILE_SIZE;
+    const int end = begin + TILE_SIZE * TILE_SIZE;
+    typename Depth::Type* depth = reinterpret_cast<typename Depth::Type*>(depthBuffer);
+    uint32_t* payload = visibilityBuffer ? primitiveBuffer : colorBuffer;
+    
+    for (int i = begin; i < end; ++i) {
+        uint64_t word = packedBuffer[i].load(std::memory_order_relaxed);
+        depth[i] = Depth::fromSortKey(static_cast<uint32_t>(word >> 32));
+        payload[i] = static_cast<uint32_t>(word);
+    }
+    
+    if (hierarchicalZ) {
+        const int BLOCKS_PER_TILE = TILE_SIZE / 8;
+        int blockX = (tileIndex % tilesX) * BLOCKS_PER_TILE;
+        int blockY = (tileIndex / tilesX) * BLOCKS_PER_TILE;
+        for (int y = blockY; y < std::min(blockY + BLOCKS_PER_TILE, blocksY); ++y) {
+            for (int x = blockX; x < std::min(blockX + BLOCKS_PER_TILE, blocksX); ++x) {
+                updateBlockMaxDepth(y * blocksX + x);
+            }
+        }
+        updateTileMaxDepth(tileIndex);
+    }
+}
+
+/**
+ * @brief Enables or disables visibility buffer (deferred shading) mode
+ * 
+ * In this mode edge function triangles write only depth and a triangle ID.
+ * Colors are produced afterwards by resolveVisibilityBuffer(), once per
+ * visible pixel, so overdraw no longer wastes shading work. The scanline
+ * path is unaffected and keeps writing colors directly.
+ */
+void Rasterizer::setVisibilityBuffer(bool enabled) {
+    flush();
+    if (multisampling && enabled != visibilityBuffer) {
+        invalidateTiles();  // Switches between the sample planes and the plain buffers
+    }
+    if (enabled && !visibilityBuffer) {
+        resetPrimitiveIds();  // IDs are not cleared while no pass reads them
+    }
+    visibilityBuffer = enabled;
+}
+
+/**
+ * @brief Stores a triangle's vertices and barycentric planes for the resolve pass
+ * 
+ * @return The triangle's primitive ID
+ */
+uint32_t Rasterizer::addVisibleTriangle(const Vertex& v1, const Vertex& v2, const Vertex& v3) {
+    VisibleTriangle visible;
+    visible.v[0] = v1;
+    visible.v[1] = v2;
+    visible.v[2] = v3;
+    visible.refX = v1.position.x;
+    visible.refY = v1.position.y;
+    
+    // Per-vertex 1/w for perspective-correct barycentrics (affine without it)
+    bool hasW = v1.position.w > 0.0f && v2.position.w > 0.0f && v3.position.w > 0.0f;
+    visible.invW[0] = hasW ? v1.position.w : 1.0f;
+    visible.invW[1] = hasW ? v2.position.w : 1.0f;
+    visible.invW[2] = hasW ? v3.position.w : 1.0f;
+    
+    // lambda1 = E20(p) / area, lambda2 = E01(p) / area; both are zero at vertex 0
+    float e1x = v2.position.x - v1.position.x;
+    float e1y = v2.position.y - v1.position.y;
+    float e2x = v3.position.x - v1.position.x;
+    float e2y = v3.position.y - v1.position.y;
+    float invArea = 1.0f / (e1x * e2y - e1y * e2x);  // Non-zero: setup rejected degenerates
+    
+    visible.dl1dx = e2y * invArea;
+    visible.dl1dy = -e2x * invArea;
+    visible.dl2dx = -e1y * invArea;
+    visible.dl2dy = e1x * invArea;
+    
+    visibleTriangles.push_back(visible);
+    return static_cast<uint32_t>(visibleTriangles.size() - 1);
+}
+
+/**
+ * @brief Shades every visible pixel of the visibility buffer
+ * 
+ * Each covered pixel looks up its triangle, reconstructs the barycentric
+ * weights at the pixel center and either interpolates the vertex colors
+ * (Gouraud) or interpolates world position and normal and evaluates
+ * Blinn-Phong (four pixels at a time with Shaders::computePhongShading4 when
+ * SSE2 is available). Pixels without a triangle keep the clear color.
+ * Tiles are resolved in parallel when a thread pool is active.
+ */
+void Rasterizer::resolveVisibilityBuffer(ShadingModel model, const Light& light,
+                                         const Material& material, const glm::vec3& viewPos) {
+    if (!visibilityBuffer) return;
+    flush();
+    
+    if (threadPool) {
+        threadPool->parallelFor(tilesX * tilesY, [&](int tileIndex) {
+            resolveTile(tileIndex, model, light, material, viewPos);
+        });
+    } else {
+        for (int tileIndex = 0; tileIndex < tilesX * tilesY; ++tileIndex) {
+            resolveTile(tileIndex, model, light, material, viewPos);
+        }
+    }
+}
+
+/**
+ * @brief Resolves the visibility buffer inside one tile
+ */
+void Rasterizer::resolveTile(int tileIndex, ShadingModel model, const Light& light,
+                             const Material& material, const glm::vec3& viewPos) {
+    if (tileStates[tileIndex] != TILE_DRAWN) return;  // No primitive IDs in this tile
+    
+    int tileX = (tileIndex % tilesX) * TILE_SIZE;
+    int tileY = (tileIndex / tilesX) * TILE_SIZE;
+    int tileMaxX = std::min(tileX + TILE_SIZE, width);
+    int tileMaxY = std::min(tileY + TILE_SIZE, height);
+    
+#ifdef LUMINA_SSE2
+    // Phong pixels are gathered into SoA batches of four and lit together
+    alignas(16) float batch[6][4] = {};  // worldPos.xyz, normal.xyz per lane
+    int batchIndex[4];
+    int batchSize = 0;
+    
+    auto shadeBatch = [&]() {
+        __m128 fragPos[3] = {_mm_load_ps(batch[0]), _mm_load_ps(batch[1]), _mm_load_ps(batch[2])};
+        __m128 normal[3] = {_mm_load_ps(batch[3]), _mm_load_ps(batch[4]), _mm_load_ps(batch[5])};
+        __m128 rgb[3];
+        Shaders::computePhongShading4(fragPos, normal, viewPos, light, material, rgb);
+        
+        alignas(16) float channels[3][4];
+        const __m128 scale = _mm_set1_ps(255.0f);
+        for (int k = 0; k < 3; ++k) {
+            _mm_store_ps(channels[k], _mm_mul_ps(rgb[k], scale));
+        }
+        for (int lane = 0; lane < batchSize; ++lane) {
+            storePixel(batchIndex[lane], static_cast<uint8_t>(channels[0][lane]),
+                       static_cast<uint8_t>(channels[1][lane]), 
+                       static_cast<uint8_t>(channels[2][lane]));
+        }
+        batchSize = 0;
+    };
+#endif
+    
+    for (int y = tileY; y < tileMaxY; ++y) {
+        for (int x = tileX; x < tileMaxX; ++x) {
+            int index = pixelIndex(x, y);
+            uint32_t id = primitiveBuffer[index];
+            if (id == NO_PRIMITIVE) continue;
+            
+            const VisibleTriangle& tri = visibleTriangles[id];
+            float dx = x + 0.5f - tri.refX;
+            float dy = y + 0.5f - tri.refY;
+            float l1 = tri.dl1dx * dx + tri.dl1dy * dy;
+            float l2 = tri.dl2dx * dx + tri.dl2dy * dy;
+            float l0 = 1.0f - l1 - l2;
+            
+            // Perspective correction: weight each vertex by its 1/w
+            l0 *= tri.invW[0];
+            l1 *= tri.invW[1];
+            l2 *= tri.invW[2];
+            float invSum = 1.0f / (l0 + l1 + l2);
+            l0 *= invSum;
+            l1 *= invSum;
+            l2 *= invSum;
+            
+            Color color;
+            if (model == SHADING_FLAT) {
+                color = tri.v[0].color;
+            } else if (model == SHADING_PHONG) {
+                glm::vec3 fragPos = tri.v[0].worldPos * l0 + tri.v[1].worldPos * l1 + 
+                                    tri.v[2].worldPos * l2;
+                glm::vec3 normal = tri.v[0].normal * l0 + tri.v[1].normal * l1 + 
+                                   tri.v[2].normal * l2;
+#ifdef LUMINA_SSE2
+                for (int k = 0; k < 3; ++k) {
+                    batch[k][batchSize] = fragPos[k];
+                    batch[k + 3][batchSize] = normal[k];
+                }
+                batchIndex[batchSize] = index;
+                if (++batchSize == 4) shadeBatch();
+                continue;
+#else
+                color = Shaders::computePhongShading(fragPos, normal, viewPos, light, material);
+#endif
+            } else {
+                color = Shaders::interpolateColor(tri.v[0].color, tri.v[1].color, 
+                                                  tri.v[2].color, l0, l1, l2);
+            }
+            
+            storePixel(index, color.r, color.g, color.b);
+        }
+    }
+    
+#ifdef LUMINA_SSE2
+    if (batchSize > 0) shadeBatch();
+#endif
+}
+
+/**
+ * @brief Enables or disables 4x multisample anti-aliasing
+ * 
+ * With MSAA, edge function triangles test coverage and depth at four sample
+ * positions per pixel but run the pixel shader only once per pixel, so
+ * edges get five levels of coverage for four times the depth work but not
+ * four times the shading (as supersampling would). Lines, circles, pixels
+ * and scanline triangles write all samples of a pixel. The sample buffers
+ * are allocated on first use, and every tile is cleared again.
+ */
+void Rasterizer::setMultisampling(bool enabled) {
+    flush();
+    if (enabled == multisampling) return;
+    multisampling = enabled;
+    
+    if (enabled && !sampleColors) {
+        sampleColors = new uint32_t[bufferSize * MSAA_SAMPLES];
+        sampleDepths = new uint8_t[bufferSize * MSAA_SAMPLES * sizeof(float)];
+    }
+    invalidateTiles();
+}
+
+/**
+ * @brief Resolves the MSAA samples of one tile into the presented frame buffer
+ * 
+ * The sample planes are stored one after another, so with SSE2 four pixels
+ * are resolved at once: one 16-byte load per plane, channels widened to 16
+ * bits and summed, rounded, divided by four and packed back to bytes, and a
+ * single 16-byte store in PIXEL_RGBA8 format. Four pixels at a multiple of
+ * four are contiguous in the tiled layout.
+ */
+void Rasterizer::resolveSampleTile(int tileIndex) {
+    int tileX = (tileIndex % tilesX) * TILE_SIZE;
+    int tileY = (tileIndex / tilesX) * TILE_SIZE;
+    int tileMaxX = std::min(tileX + TILE_SIZE, width);
+    int tileMaxY = std::min(tileY + TILE_SIZE, height);
+    const int planeSize = bufferSize;
+    
+    for (int y = tileY; y < tileMaxY; ++y) {
+        int x = tileX;
+        
+#ifdef LUMINA_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i rounding = _mm_set1_epi16(MSAA_SAMPLES / 2);
+        
+        for (; x + 3 < tileMaxX; x += 4) {
+            int index = y * width + x;
+            int sampleIndex = pixelIndex(x, y);
+            __m128i low = rounding;    // Pixels 0 and 1, 16 bits per channel
+            __m128i high = rounding;   // Pixels 2 and 3
+            for (int s = 0; s < MSAA_SAMPLES; ++s) {
+                __m128i samples = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(sampleColors + s * planeSize + sampleIndex));
+                low = _mm_add_epi16(low, _mm_unpacklo_epi8(samples, zero));
+                high = _mm_add_epi16(high, _mm_unpackhi_epi8(samples, zero));
+            }
+            __m128i average = _mm_packus_epi16(_mm_srli_epi16(low, 2), _mm_srli_epi16(high, 2));
+            
+            if (pixelFormat == PIXEL_RGBA8) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(
+                    reinterpret_cast<uint32_t*>(frameBuffer) + index), average);
+            } else {
+                alignas(16) uint8_t bytes[16];
+                _mm_store_si128(reinterpret_cast<__m128i*>(bytes), average);
+                uint8_t* pixel = frameBuffer + index * 3;
+                for (int lane = 0; lane < 4; ++lane) {
+                    pixel[lane * 3 + 0] = bytes[lane * 4 + 0];
+                    pixel[lane * 3 + 1] = bytes[lane * 4 + 1];
+                    pixel[lane * 3 + 2] = bytes[lane * 4 + 2];
+                }
+            }
+        }
+#endif
+        
+        for (; x < tileMaxX; ++x) {
+            int index = y * width + x;
+            int sampleIndex = pixelIndex(x, y);
+            uint32_t sum[4] = {MSAA_SAMPLES / 2, MSAA_SAMPLES / 2, MSAA_SAMPLES / 2, MSAA_SAMPLES / 2};
+            for (int s = 0; s < MSAA_SAMPLES; ++s) {
+                uint32_t color = sampleColors[s * planeSize + sampleIndex];
+                for (int c = 0; c < 4; ++c) {
+                    sum[c] += (color >> (8 * c)) & 0xFF;
+                }
+            }
+            
+            if (pixelFormat == PIXEL_RGBA8) {
+                reinterpret_cast<uint32_t*>(frameBuffer)[index] = 
+                    (sum[0] / MSAA_SAMPLES) | ((sum[1] / MSAA_SAMPLES) << 8) |
+                    ((sum[2] / MSAA_SAMPLES) << 16) | ((sum[3] / MSAA_SAMPLES) << 24);
+            } else {
+                for (int c = 0; c < 3; ++c) {
+                    frameBuffer[index * 3 + c] = static_cast<uint8_t>(sum[c] / MSAA_SAMPLES);
+                }
+            }
+        }
+    }
+}
+
+#ifdef LUMINA_SSE2
+/**
+ * @brief Coverage of four pixel centers: in the span and inside every partial edge
+ */
+static inline __m128 centerCoverage4(__m128i inSpan, const __m128i edge[3], int partialEdges) {
+    __m128i cover = inSpan;
+    for (int k = 0; k < 3; ++k) {
+        if (partialEdges & (1 << k)) {
+            cover = _mm_and_si128(cover, _mm_cmpgt_epi32(edge[k], _mm_set1_epi32(-1)));
+        }
+    }
+    return _mm_castsi128_ps(cover);
+}
+
+/**
+ * @brief Stores value to the lanes of four words where pass is set; the
+ * other lanes keep their old value
+ */
+static inline void storeMasked4(uint32_t* buffer, __m128 pass, __m128i value) {
+    __m128i* words = reinterpret_cast<__m128i*>(buffer);
+    __m128i passInt = _mm_castps_si128(pass);
+    __m128i old = _mm_loadu_si128(words);
+    _mm_storeu_si128(words, _mm_or_si128(_mm_and_si128(passInt, value), 
+                                         _mm_andnot_si128(passInt, old)));
+}
+#endif
+
+/**
+ * @brief Coverage of one pixel center by the partial edges
+ */
+static inline bool centerCovered(const int32_t edge[3], int partialEdges) {
+    for (int k = 0; k < 3; ++k) {
+        if ((partialEdges & (1 << k)) && edge[k] < 0) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Write policy of shadeBlock(): tiled depth buffer in Depth plus the
+ * color or triangle ID buffer
+ * 
+ * Every policy of shadeBlockInto() has the same four members. test4() and
+ * test() take the edge values at the pixel centers (meaningful for partial
+ * edges only) and the fragment depth, run coverage and the depth test and
+ * return the pixels to write. write4() and write() then store the shaded
+ * color or the triangle ID to those pixels and return true if anything
+ * was written.
+ */
+template <typename Shader, typename Depth>
+struct PixelTarget {
+    typename Depth::Type* depth;
+    uint32_t* colors;
+    uint32_t* ids;
+    
+#ifdef LUMINA_SSE2
+    __m128 test4(int index, __m128i inSpan, const __m128i edge[3], int partialEdges, __m128 z) {
+        return Depth::test4(depth + index, z, centerCoverage4(inSpan, edge, partialEdges));
+    }
+    
+    bool write4(int index, __m128 pass, __m128i payload) {
+        if constexpr (Shader::OUTPUT != OUTPUT_DEPTH_ONLY) {
+            uint32_t* buffer = Shader::OUTPUT == OUTPUT_PRIMITIVE_ID ? ids : colors;
+            storeMasked4(buffer + index, pass, payload);
+        }
+        return true;
+    }
+#endif
+    
+    bool test(int index, const int32_t edge[3], int partialEdges, float z) {
+        return centerCovered(edge, partialEdges) && Depth::test(depth[index], z);
+    }
+    
+    bool write(int index, uint32_t payload) {
+        if constexpr (Shader::OUTPUT == OUTPUT_PRIMITIVE_ID) {
+            ids[index] = payload;
+        } else if constexpr (Shader::OUTPUT == OUTPUT_COLOR) {
+            colors[index] = payload;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Write policy of shadeBlockMultisample(): coverage and the depth
+ * test at every sample, one color stored to every sample that passed
+ * 
+ * A sample's edge and depth values differ from the pixel center's by
+ * per-triangle constants.
+ */
+template <typename Shader, typename Depth>
+struct MultisampleTarget {
+    typename Depth::Type* depth;
+    uint32_t* colors;
+    int planeSize;
+    int32_t sampleE[Rasterizer::MSAA_SAMPLES][3];
+    float sampleZ[Rasterizer::MSAA_SAMPLES];
+    
+#ifdef LUMINA_SSE2
+    __m128 pass[Rasterizer::MSAA_SAMPLES];
+    
+    __m128 test4(int index, __m128i inSpan, const __m128i edge[3], int partialEdges, __m128 z) {
+        __m128 anyPass = _mm_setzero_ps();
+        for (int s = 0; s < Rasterizer::MSAA_SAMPLES; ++s) {
+            __m128i sampleEdge[3];
+            for (int k = 0; k < 3; ++k) {
+                sampleEdge[k] = _mm_add_epi32(edge[k], _mm_set1_epi32(sampleE[s][k]));
+            }
+            
+            __m128 sampleDepth = _mm_add_ps(z, _mm_set1_ps(sampleZ[s]));
+            pass[s] = Depth::test4(depth + s * planeSize + index, sampleDepth, 
+                                   centerCoverage4(inSpan, sampleEdge, partialEdges));
+            anyPass = _mm_or_ps(anyPass, pass[s]);
+        }
+        return anyPass;
+    }
+    
+    bool write4(int index, __m128, __m128i payload) {
+        if constexpr (Shader::OUTPUT == OUTPUT_COLOR) {
+            for (int s = 0; s < Rasterizer::MSAA_SAMPLES; ++s) {
+                if (!_mm_movemask_ps(pass[s])) continue;
+                storeMasked4(colors + s * planeSize + index, pass[s], payload);
+            }
+        }
+        return true;
+    }
+#endif
+    
+    int passBits;
+    
+    bool test(int index, const int32_t edge[3], int partialEdges, float z) {
+        passBits = 0;
+        for (int s = 0; s < Rasterizer::MSAA_SAMPLES; ++s) {
+            int32_t sampleEdge[3];
+            for (int k = 0; k < 3; ++k) {
+                sampleEdge[k] = edge[k] + sampleE[s][k];
+            }
+            if (centerCovered(sampleEdge, partialEdges) && 
+                Depth::test(depth[s * planeSize + index], z + sampleZ[s])) {
+                passBits |= 1 << s;
+            }
+        }
+        return passBits != 0;
+    }
+    
+    bool write(int index, uint32_t payload) {
+        if constexpr (Shader::OUTPUT == OUTPUT_COLOR) {
+            for (int s = 0; s < Rasterizer::MSAA_SAMPLES; ++s) {
+                if (passBits & (1 << s)) {
+                    colors[s * planeSize + index] = payload;
+                }
+            }
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Write policy of shadeBlockSortLast(): atomic (depth key << 32 |
+ * payload) words
+ * 
+ * The test reads the word's current key, which skips the shader for pixels
+ * already hidden; write merges with an atomic minimum, which settles any
+ * race with other threads. Depth-only writes lower the key and keep the
+ * payload. The keys quantize depth like Depth stores it.
+ */
+template <typename Shader, typename Depth>
+struct SortLastTarget {
+    std::atomic<uint64_t>* words;
+    
+    static bool visible(uint32_t key, uint32_t storedKey) {
+        return Shader::OUTPUT == OUTPUT_DEPTH_ONLY ? key < storedKey : key <= storedKey;
+    }
+    
+    bool writeWord(int index, uint32_t key, uint32_t payload) {
+        if constexpr (Shader::OUTPUT == OUTPUT_DEPTH_ONLY) {
+            return atomicMinDepth(words[index], key);
+        } else {
+            return atomicMinWord(words[index], (static_cast<uint64_t>(key) << 32) | payload);
+        }
+    }
+    
+#ifdef LUMINA_SSE2
+    alignas(16) uint32_t keys[4];
+    int passBits4;
+    
+    __m128 test4(int index, __m128i inSpan, const __m128i edge[3], int partialEdges, __m128 z) {
+        int coverBits = _mm_movemask_ps(centerCoverage4(inSpan, edge, partialEdges));
+        passBits4 = 0;
+        if (!coverBits) return _mm_setzero_ps();
+        
+        // Depth keys of the four pixels; early test against the current words
+        _mm_store_si128(reinterpret_cast<__m128i*>(keys), Depth::sortKey4(z));
+        for (int lane = 0; lane < 4; ++lane) {
+            if (!(coverBits & (1 << lane))) continue;
+            uint32_t storedKey = static_cast<uint32_t>(
+                words[index + lane].load(std::memory_order_relaxed) >> 32);
+            if (visible(keys[lane], storedKey)) passBits4 |= 1 << lane;
+        }
+        return _mm_castsi128_ps(_mm_cmpgt_epi32(
+            _mm_and_si128(_mm_set1_epi32(passBits4), _mm_setr_epi32(1, 2, 4, 8)), 
+            _mm_setzero_si128()));
+    }
+    
+    bool write4(int index, __m128, __m128i payload) {
+        alignas(16) uint32_t payloads[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(payloads), payload);
+        bool written = false;
+        for (int lane = 0; lane < 4; ++lane) {
+            if (passBits4 & (1 << lane)) {
+                written |= writeWord(index + lane, keys[lane], payloads[lane]);
+            }
+        }
+        return written;
+    }
+#endif
+    
+    uint32_t key;
+    
+    bool test(int index, const int32_t edge[3], int partialEdges, float z) {
+        if (!centerCovered(edge, partialEdges)) return false;
+        key = Depth::sortKey(Depth::encode(z));
+        return visible(key, static_cast<uint32_t>(
+            words[index].load(std::memory_order_relaxed) >> 32));
+    }
+    
+    bool write(int index, uint32_t payload) {
+        return writeWord(index, key, payload);
+    }
+};
+
+/**
+ * @brief Write policy of shadeBlockPrepassOwner(): the Z-equal pass after
+ * a depth prepass, which shades a pixel only for the triangle whose prepass
+ * index was left there
+ * 
+ * The depth buffer already holds the prepass result and is not touched.
+ */
+template <typename Shader>
+struct PrepassOwnerTarget {
+    const uint32_t* ids;
+    uint32_t* colors;
+    uint32_t id;
+    
+#ifdef LUMINA_SSE2
+    __m128 test4(int index, __m128i inSpan, const __m128i edge[3], int partialEdges, __m128) {
+        __m128i owners = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ids + index));
+        __m128i owned = _mm_cmpeq_epi32(owners, _mm_set1_epi32(static_cast<int>(id)));
+        return _mm_and_ps(centerCoverage4(inSpan, edge, partialEdges), _mm_castsi128_ps(owned));
+    }
+    
+    bool write4(int index, __m128 pass, __m128i payload) {
+        if constexpr (Shader::OUTPUT == OUTPUT_COLOR) {
+            storeMasked4(colors + index, pass, payload);
+        }
+        return true;
+    }
+#endif
+    
+    bool test(int index, const int32_t edge[3], int partialEdges, float) {
+        return centerCovered(edge, partialEdges) && ids[index] == id;
+    }
+    
+    bool write(int index, uint32_t payload) {
+        if constexpr (Shader::OUTPUT == OUTPUT_COLOR) {
+            colors[index] = payload;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Shades the pixels of one 8x8 block for the edge function rasterizer
+ * 
+ * Only edges that cross the block (partialEdges) are tested; their values at
+ * the block's first pixel are passed in blockE and stepped with exact 32-bit
+ * integer adds. Depth, 1/w and the varyings are evaluated from their planes
+ * at every pixel center: the y term once per row, then one multiply-add per
+ * pixel (per group of four with SSE2), so there is no error carried along
+ * the row and the SSE2 and scalar loops agree bit for bit. Varyings are only
+ * evaluated for pixels that pass the depth test, are interpolated
+ * perspective-correctly as (v / w) / (1 / w) and handed to the shader's
+ * fragment stage.
+ * 
+ * Instantiated once per pixel shader (see PixelShaders.h): the number of
+ * varyings, the fragment stage and the kind of output (color, depth only or
+ * triangle ID) are compile-time constants, so each shader gets its own loop
+ * without per-pixel branches on the shading mode. The depth test and the
+ * stores come from Target (PixelTarget, MultisampleTarget or
+ * SortLastTarget), which is inlined into the same loop.
+ * 
+ * With SSE2 each row is processed four pixels at a time: coverage, depth
+ * test and color interpolation are evaluated for all four lanes at once and
+ * the targets write with masked vector stores. Lanes that fail coverage or
+ * the depth test keep their old value, so there is no per-pixel branch.
+ * Non-SSE2 builds use the scalar loop.
+ * 
+ * @return true if the target reported a write
+ */
+template <typename Shader, typename Target>
+bool Rasterizer::shadeBlockInto(const TriangleSetup& tri, int bx, int by, 
+                                const int32_t blockE[3], int partialEdges, 
+                                int startX, int startY, int endX, int endY, Target& target) {
+    bool written = false;
+    const int varyingCount = Shader::VARYING_COUNT;
+    const ShaderUniforms& uniforms = *shaderUniforms;
+    
+#ifdef LUMINA_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 maxChannel = _mm_set1_ps(255.0f);
+    const __m128i laneIndex = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i minusOne = _mm_set1_epi32(-1);
+    const __m128i opaque = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+    const __m128i firstX = _mm_set1_epi32(startX);
+    const __m128i lastX = _mm_set1_epi32(endX);
+    
+    // Edge offsets of the four lanes within a group
+    __m128i laneE[3];
+    for (int k = 0; k < 3; ++k) {
+        laneE[k] = _mm_setr_epi32(0, tri.A[k], 2 * tri.A[k], 3 * tri.A[k]);
+    }
+    
+    // Plane slopes along x, applied at each group's own pixel centers
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 refX = _mm_set1_ps(tri.refX);
+    const __m128 zDdx = _mm_set1_ps(tri.depth.ddx);
+    const __m128 invWDdx = _mm_set1_ps(tri.invW.ddx);
+    __m128 varyingDdx[MAX_VARYINGS];
+    for (int k = 0; k < varyingCount; ++k) {
+        varyingDdx[k] = _mm_set1_ps(tri.varyings[k].ddx);
+    }
+#endif
+    
+    for (int y = startY; y <= endY; ++y) {
+        // Edge values at (bx, y); only meaningful for partial edges
+        int32_t rowE[3];
+        for (int k = 0; k < 3; ++k) {
+            rowE[k] = blockE[k] + tri.B[k] * (y - by);
+        }
+        
+        // Row terms of the planes; both loops below add ddx * dx per pixel,
+        // which is AttributePlane::at() with no error carried along the row
+        float dy = y + 0.5f - tri.refY;
+        float zRow = tri.depth.rowValue(dy);
+        float invWRow = tri.invW.rowValue(dy);
+        float varyingRow[MAX_VARYINGS];
+        for (int k = 0; k < varyingCount; ++k) {
+            varyingRow[k] = tri.varyings[k].rowValue(dy);
+        }
+        
+        int x = startX & ~3;  // Groups of four start on a multiple of four
+        int rowIndex = pixelIndex(bx, y) - bx;  // A block row is contiguous
+        
+#ifdef LUMINA_SSE2
+        for (; x <= endX; x += 4) {
+            // Depth at the four pixel centers (see the row terms above)
+            __m128i xs = _mm_add_epi32(_mm_set1_epi32(x), laneIndex);
+            __m128 dx = _mm_sub_ps(_mm_add_ps(_mm_cvtepi32_ps(xs), half), refX);
+            __m128 z = _mm_add_ps(_mm_set1_ps(zRow), _mm_mul_ps(zDdx, dx));
+            
+            // Lanes outside [startX, endX] never write
+            __m128i inSpan = _mm_xor_si128(_mm_or_si128(_mm_cmplt_epi32(xs, firstX), 
+                                                        _mm_cmpgt_epi32(xs, lastX)), minusOne);
+            __m128i edge[3];
+            for (int k = 0; k < 3; ++k) {
+                edge[k] = _mm_add_epi32(_mm_set1_epi32(rowE[k] + tri.A[k] * (x - bx)), laneE[k]);
+            }
+            
+            __m128 pass = target.test4(rowIndex + x, inSpan, edge, partialEdges, z);
+            if (!_mm_movemask_ps(pass)) continue;
+            
+            __m128i payload = _mm_setzero_si128();
+            if constexpr (Shader::OUTPUT == OUTPUT_PRIMITIVE_ID) {
+                payload = _mm_set1_epi32(static_cast<int>(tri.primitiveId));
+            } else if constexpr (Shader::OUTPUT == OUTPUT_COLOR) {
+                // Perspective-correct varyings: (v / w) / (1 / w)
+                __m128 varying[MAX_VARYINGS];
+                if constexpr (Shader::VARYING_COUNT > 0) {
+                    __m128 invW = _mm_add_ps(_mm_set1_ps(invWRow), _mm_mul_ps(invWDdx, dx));
+                    __m128 w = _mm_div_ps(one, invW);
+                    for (int k = 0; k < varyingCount; ++k) {
+                        varying[k] = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(varyingRow[k]), 
+                                                           _mm_mul_ps(varyingDdx[k], dx)), w);
+                    }
+                }
+                
+                __m128 rgb[3];
+                Shader::shade4(varying, tri.constants, uniforms, rgb);
+                
+                // Clamp and convert all four colors at once, then pack to
+                // R | G << 8 | B << 16 | A << 24
+                __m128i red = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(rgb[0], zero), maxChannel));
+                __m128i green = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(rgb[1], zero), maxChannel));
+                __m128i blue = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(rgb[2], zero), maxChannel));
+                payload = _mm_or_si128(_mm_or_si128(red, _mm_slli_epi32(green, 8)),
+                                       _mm_or_si128(_mm_slli_epi32(blue, 16), opaque));
+            }
+            written |= target.write4(rowIndex + x, pass, payload);
+        }
+#endif
+        
+        // Scalar loop: the whole row without SSE2
+        x = std::max(x, startX);
+        for (; x <= endX; ++x) {
+            float dx = x + 0.5f - tri.refX;
+            float z = zRow + tri.depth.ddx * dx;
+            
+            int32_t edge[3];
+            for (int k = 0; k < 3; ++k) {
+                edge[k] = rowE[k] + tri.A[k] * (x - bx);
+            }
+            
+            int index = rowIndex + x;
+            if (!target.test(index, edge, partialEdges, z)) continue;
+            
+            uint32_t payload = 0;
+            if constexpr (Shader::OUTPUT == OUTPUT_PRIMITIVE_ID) {
+                payload = tri.primitiveId;
+            } else if constexpr (Shader::OUTPUT == OUTPUT_COLOR) {
+                float varying[MAX_VARYINGS];
+                if constexpr (Shader::VARYING_COUNT > 0) {
+                    float w = 1.0f / (invWRow + tri.invW.ddx * dx);
+                    for (int k = 0; k < varyingCount; ++k) {
+                        varying[k] = (varyingRow[k] + tri.varyings[k].ddx * dx) * w;
+                    }
+                }
+                
+                float rgb[3];
+                Shader::shade(varying, tri.constants, uniforms, rgb);
+                payload = packColor(static_cast<uint8_t>(std::min(std::max(rgb[0], 0.0f), 255.0f)),
+                                    static_cast<uint8_t>(std::min(std::max(rgb[1], 0.0f), 255.0f)),
+                                    static_cast<uint8_t>(std::min(std::max(rgb[2], 0.0f), 255.0f)));
+            }
+            written |= target.write(index, payload);
+        }
+    }
+    
+    return written;
+}
+
+/**
+ * @brief Shades one 8x8 block into the depth buffer and the color or
+ * triangle ID buffer
+ * 
+ * @return true if at least one pixel passed the depth test
+ */
+template <typename Shader, typename Depth>
+bool Rasterizer::shadeBlock(const TriangleSetup& tri, int bx, int by, const int32_t blockE[3],
+                            int partialEdges, int startX, int startY, int endX, int endY) {
+    PixelTarget<Shader, Depth> target;
+    target.depth = reinterpret_cast<typename Depth::Type*>(depthBuffer);
+    target.colors = colorBuffer;
+    target.ids = primitiveBuffer;
+    return shadeBlockInto<Shader>(tri, bx, by, blockE, partialEdges, 
+                                  startX, startY, endX, endY, target);
+}
+
+/**
+ * @brief Shades one 8x8 block with 4x multisampling
+ * 
+ * Coverage and the depth test are evaluated at every sample. The shader
+ * runs once per pixel (four pixels with SSE2), at the pixel center, when
+ * any sample passes, and its color is stored to every passing sample.
+ */
+template <typename Shader, typename Depth>
+bool Rasterizer::shadeBlockMultisample(const TriangleSetup& tri, int bx, int by, 
+                                       const int32_t blockE[3], int partialEdges, 
+                                       int startX, int startY, int endX, int endY) {
+    MultisampleTarget<Shader, Depth> target;
+    target.depth = reinterpret_cast<typename Depth::Type*>(sampleDepths);
+    target.colors = sampleColors;
+    target.planeSize = bufferSize;
+    
+    // Edge and depth offsets from a pixel center to each sample
+    for (int s = 0; s < MSAA_SAMPLES; ++s) {
+        int offsetX = MSAA_SAMPLE_OFFSETS[s][0];
+        int offsetY = MSAA_SAMPLE_OFFSETS[s][1];
+        for (int k = 0; k < 3; ++k) {
+            target.sampleE[s][k] = (tri.A[k] >> SUBPIXEL_BITS) * offsetX + 
+                                   (tri.B[k] >> SUBPIXEL_BITS) * offsetY;
+        }
+        target.sampleZ[s] = (tri.depth.ddx * offsetX + tri.depth.ddy * offsetY) / 
+                            (1 << SUBPIXEL_BITS);
+    }
+    
+    return shadeBlockInto<Shader>(tri, bx, by, blockE, partialEdges, 
+                                  startX, startY, endX, endY, target);
+}
+
+/**
+ * @brief Shades the pixels of one 8x8 block into the sort-last target
+ * 
+ * @return true if at least one word was lowered
+ */
+template <typename Shader, typename Depth>
+bool Rasterizer::shadeBlockSortLast(const TriangleSetup& tri, int bx, int by, 
+                                    const int32_t blockE[3], int partialEdges, 
+                                    int startX, int startY, int endX, int endY) {
+    SortLastTarget<Shader, Depth> target;
+    target.words = packedBuffer;
+    return shadeBlockInto<Shader>(tri, bx, by, blockE, partialEdges, 
+                                  startX, startY, endX, endY, target);
+}
+
+/**
+ * @brief Shades the pixels of one 8x8 block that the triangle owns after
+ * the depth prepass
+ */
+template <typename Shader>
+bool Rasterizer::shadeBlockPrepassOwner(const TriangleSetup& tri, int bx, int by, 
+                                        const int32_t blockE[3], int partialEdges, 
+                                        int startX, int startY, int endX, int endY) {
+    PrepassOwnerTarget<Shader> target;
+    target.ids = primitiveBuffer;
+    target.colors = colorBuffer;
+    target.id = tri.primitiveId;
+    return shadeBlockInto<Shader>(tri, bx, by, blockE, partialEdges, 
+                                  startX, startY, endX, endY, target);
+}
+
+/**
+ * @brief Shades one 8x8 block with the fill loop instantiated for the
+ * triangle's pixel shader and the depth format and test
+ * 
+ * The switches run once per block; everything inside shadeBlock() is
+ * specialized at compile time.
+ */
+bool Rasterizer::fillBlock(const TriangleSetup& tri, int bx, int by, const int32_t blockE[3],
+                           int partialEdges, int startX, int startY, int endX, int endY) {
+    if (sortLastActive()) {
+        switch (depthFormat) {
+            case DEPTH_UNORM16:
+                return fillBlockSortLast<DepthUnorm16>(tri, bx, by, blockE, partialEdges, 
+                                                       startX, startY, endX, endY);
+            case DEPTH_UNORM24:
+                return fillBlockSortLast<DepthUnorm24>(tri, bx, by, blockE, partialEdges, 
+                                                       startX, startY, endX, endY);
+            default:
+                return fillBlockSortLast<DepthFloat32>(tri, bx, by, blockE, partialEdges, 
+                                                       startX, startY, endX, endY);
+        }
+    }
+    
+    if (prepassOwners) {
+        return fillBlockPrepassOwner(tri, bx, by, blockE, partialEdges, 
+                                     startX, startY, endX, endY);
+    }
+    
+    if (depthTest == DEPTH_TEST_EQUAL) {
+        switch (depthFormat) {
+            case DEPTH_UNORM16:
+                return fillBlockWithDepth<DepthEqual<DepthUnorm16>>(
+                    tri, bx, by, blockE, partialEdges, startX, startY, endX, endY);
+            case DEPTH_UNORM24:
+                return fillBlockWithDepth<DepthEqual<DepthUnorm24>>(
+                    tri, bx, by, blockE, partialEdges, startX, startY, endX, endY);
+            default:
+                return fillBlockWithDepth<DepthEqual<DepthFloat32>>(
+                    tri, bx, by, blockE, partialEdges, startX, startY, endX, endY);
+        }
+    }
+    
+    switch (depthFormat) {
+        case DEPTH_UNORM16:
+            return fillBlockWithDepth<DepthUnorm16>(tri, bx, by, blockE, partialEdges, 
+                                                    startX, startY, endX, endY);
+        case DEPTH_UNORM24:
+            return fillBlockWithDepth<DepthUnorm24>(tri, bx, by, blockE, partialEdges, 
+                                                    startX, startY, endX, endY);
+        default:
+            return fillBlockWithDepth<DepthFloat32>(tri, bx, by, blockE, partialEdges, 
+                                                    startX, startY, endX, endY);
+    }
+}
+
+/**
+ * @brief Pixel shader dispatch of fillBlock() into the sort-last target
+ */
+template <typename Depth>
+bool Rasterizer::fillBlockSortLast(const TriangleSetup& tri, int bx, int by, 
+                                   const int32_t blockE[3], int partialEdges, 
+                                   int startX, int startY, int endX, int endY) {
+    switch (tri.shader) {
+        case PIXEL_SHADER_FLAT:
+            return shadeBlockSortLast<FlatShader, Depth>(tri, bx, by, blockE, partialEdges, 
+                                                         startX, startY, endX, endY);
+        case PIXEL_SHADER_GOURAUD:
+            return shadeBlockSortLast<GouraudShader, Depth>(tri, bx, by, blockE, partialEdges, 
+                                                            startX, startY, endX, endY);
+        case PIXEL_SHADER_PHONG:
+            return shadeBlockSortLast<PhongShader, Depth>(tri, bx, by, blockE, partialEdges, 
+                                                          startX, startY, endX, endY);
+        case PIXEL_SHADER_DEPTH_ONLY:
+            return shadeBlockSortLast<DepthOnlyShader, Depth>(tri, bx, by, blockE, partialEdges, 
+                                                              startX, startY, endX, endY);
+        default:
+            return shadeBlockSortLast<PrimitiveIdShader, Depth>(tri, bx, by, blockE, partialEdges, 
+                                                                startX, startY, endX, endY);
+    }
+}
+
+/**
+ * @brief Pixel shader dispatch of fillBlock() for the Z-equal pass after a
+ * depth prepass
+ */
+bool Rasterizer::fillBlockPrepassOwner(const TriangleSetup& tri, int bx, int by, 
+                                       const int32_t blockE[3], int partialEdges, 
+                                       int startX, int startY, int endX, int endY) {
+    switch (tri.shader) {
+        case PIXEL_SHADER_FLAT:
+            return shadeBlockPrepassOwner<FlatShader>(tri, bx, by, blockE, partialEdges, 
+                                                      startX, startY, endX, endY);
+        case PIXEL_SHADER_GOURAUD:
+            return shadeBlockPrepassOwner<GouraudShader>(tri, bx, by, blockE, partialEdges, 
+                                                         startX, startY, endX, endY);
+        case PIXEL_SHADER_PHONG:
+            return shadeBlockPrepassOwner<PhongShader>(tri, bx, by, blockE, partialEdges, 
+                                                       startX, startY, endX, endY);
+        default:
+            return shadeBlockPrepassOwner<DepthOnlyShader>(tri, bx, by, blockE, partialEdges, 
+                                                           startX, startY, endX, endY);
+    }
+}
+
+/**
+ * @brief Pixel shader dispatch of fillBlock() for one depth format
+ */
+template <typename Depth>
+bool Rasterizer::fillBlockWithDepth(const TriangleSetup& tri, int bx, int by, 
+                                    const int32_t blockE[3], int partialEdges, 
+                                    int startX, int startY, int endX, int endY) {
+    if (multisampleActive()) {
+        // No triangle IDs here: the visibility buffer disables MSAA, and a
+        // depth prepass keeps sample depths only
+        switch (tri.shader) {
+            case PIXEL_SHADER_FLAT:
+                return shadeBlockMultisample<FlatShader, Depth>(
+                    tri, bx, by, blockE, partialEdges, startX, startY, endX, endY);
+            case PIXEL_SHADER_GOURAUD:
+                return shadeBlockMultisample<GouraudShader, Depth>(
+                    tri, bx, by, blockE, partialEdges, startX, startY, endX, endY);
+            case PIXEL_SHADER_PHONG:
+                return shadeBlockMultisample<PhongShader, Depth>(
+                    tri, bx, by, blockE, partialEdges, startX, startY, endX, endY);
+            default:
+                return shadeBlockMultisample<DepthOnlyShader, Depth>(
+                    tri, bx, by, blockE, partialEdges, startX, startY, endX, endY);
+        }
+    }
+    
+    switch (tri.shader) {
+        case PIXEL_SHADER_FLAT:
+            return shadeBlock<FlatShader, Depth>(tri, bx, by, blockE, partialEdges, 
+                                                 startX, startY, endX, endY);
+        case PIXEL_SHADER_GOURAUD:
+            return shadeBlock<GouraudShader, Depth>(tri, bx, by, blockE, partialEdges, 
+                                                    startX, startY, endX, endY);
+        case PIXEL_SHADER_PHONG:
+            return shadeBlock<PhongShader, Depth>(tri, bx, by, blockE, partialEdges, 
+                                                  startX, startY, endX, endY);
+        case PIXEL_SHADER_DEPTH_ONLY:
+            return shadeBlock<DepthOnlyShader, Depth>(tri, bx, by, blockE, partialEdges, 
+                                                      startX, startY, endX, endY);
+        default:
+            return shadeBlock<PrimitiveIdShader, Depth>(tri, bx, by, blockE, partialEdges, 
+                                                        startX, startY, endX, endY);
+    }
+}
+
+/**
+ * @brief Draws a wireframe triangle
+ */
+void Rasterizer::drawWireframeTriangle(const Vertex& v1, const Vertex& v2, 
+                                      const Vertex& v3, const Color& color) {
+    int x1 = static_cast<int>(v1.position.x);
+    int y1 = static_cast<int>(v1.position.y);
+    int x2 = static_cast<int>(v2.position.x);
+    int y2 = static_cast<int>(v2.position.y);
+    int x3 = static_cast<int>(v3.position.x);
+    int y3 = static_cast<int>(v3.position.y);
+    
+    draw_line(x1, y1, x2, y2, color);
+    draw_line(x2, y2, x3, y3, color);
+    draw_line(x3, y3, x1, y1, color);
+}
+
+/**
+ * @brief Computes barycentric coordinates for point (x,y) in triangle (v1,v2,v3)
+ * 
+ * Barycentric coordinates allow us to interpolate values across a triangle.
+ * They represent the weights of each vertex for a point inside the triangle.
+ */
+glm::vec3 Rasterizer::computeBarycentric(float x, float y, const glm::vec2& v1, 
+                                         const glm::vec2& v2, const glm::vec2& v3) {
+    float denominator = (v2.y - v3.y) * (v1.x - v3.x) + (v3.x - v2.x) * (v1.y - v3.y);
+    
+    if (std::abs(denominator) < 1e-6f) {
+        return glm::vec3(1.0f / 3.0f);  // Degenerate triangle
+    }
+    
+    float w1 = ((v2.y - v3.y) * (x - v3.x) + (v3.x - v2.x) * (y - v3.y)) / denominator;
+    float w2 = ((v3.y - v1.y) * (x - v3.x) + (v1.x - v3.x) * (y - v3.y)) / denominator;
+    float w3 = 1.0f - w1 - w2;
+    
+    return glm::vec3(w1, w2, w3);
+}
+
+/**
+ * @brief Writes an opaque color at a tiled pixel index (see pixelIndex())
+ * 
+ * With MSAA the color goes to every sample of the pixel, so that primitives
+ * drawn without coverage information survive the resolve.
+ */
+void Rasterizer::storePixel(int index, uint8_t r, uint8_t g, uint8_t b) {
+    if (multisampleActive()) {
+        uint32_t packed = packColor(r, g, b);
+        for (int s = 0; s < MSAA_SAMPLES; ++s) {
+            sampleColors[s * bufferSize + index] = packed;
+        }
+    } else {
+        colorBuffer[index] = packColor(r, g, b);
+    }
+}
+
+/**
+ * @brief Sets a pixel in the frame buffer
+ */
+void Rasterizer::setPixel(int x, int y, const Color& color) {
+    if (!isInBounds(x, y)) return;
+    
+    prepareTile((y / TILE_SIZE) * tilesX + x / TILE_SIZE);
+    storePixel(pixelIndex(x, y), color.r, color.g, color.b);
+}
+
+/**
+ * @brief Sets a pixel with Z-buffer depth testing
+ * 
+ * This implements the Z-buffer algorithm for hidden surface removal.
+ * Only draws the pixel if it's closer to the camera than the current depth value.
+ */
 void Rasterizer::setPixelWithDepth(int x, int y, float depth, const Color& color) {
     if (!isInBounds(x, y)) return;
     
-    int index = y * width + x;
+    int index = pixelIndex(x, y);
+    prepareTile((y / TILE_SIZE) * tilesX + x / TILE_SIZE);
+    
+    // With MSAA every sample is depth tested on its own
+    if (multisampleActive()) {
+        uint32_t packed = packColor(color.r, color.g, color.b);
+        for (int s = 0; s < MSAA_SAMPLES; ++s) {
+            int sampleIndex = s * bufferSize + index;
+            if (testDepth(sampleDepths, sampleIndex, depth)) {
+                sampleColors[sampleIndex] = packed;
+            }
+        }
+        return;
+    }
     
     // Depth test: only draw if closer to camera
-    if (depth < depthBuffer[index]) {
-        depthBuffer[index] = depth;
-        
-        int colorIndex = index * 3;
-        frameBuffer[colorIndex + 0] = color.r;
-        frameBuffer[colorIndex + 1] = color.g;
-        frameBuffer[colorIndex + 2] = color.b;
+    if (testDepth(depthBuffer, index, depth)) {
+        storePixel(index, color.r, color.g, color.b);
     }
 }
 
@@ -82,6 +82,130 @@ Color Shaders::computePhongShading(
     return vec3ToColor(finalColor);
 }
 
+#ifdef LUMINA_SSE2
+/**
+ * @brief Normalizes four vectors (SoA) using rsqrt refined by one Newton step
+ */
+static void normalize4(__m128 v[3]) {
+    __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v[0], v[0]), _mm_mul_ps(v[1], v[1])),
+                                 _mm_mul_ps(v[2], v[2]));
+    
+    // r' = r * (1.5 - 0.5 * x * r * r) brings rsqrt's 12 bits to about 22
+    __m128 r = _mm_rsqrt_ps(lengthSq);
+    __m128 halfX = _mm_mul_ps(_mm_set1_ps(0.5f), lengthSq);
+    r = _mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(halfX, _mm_mul_ps(r, r))));
+    
+    v[0] = _mm_mul_ps(v[0], r);
+    v[1] = _mm_mul_ps(v[1], r);
+    v[2] = _mm_mul_ps(v[2], r);
+}
+
+/**
+ * @brief Dot products of four pairs of vectors (SoA)
+ */
+static __m128 dot4(const __m128 a[3], const __m128 b[3]) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])),
+                      _mm_mul_ps(a[2], b[2]));
+}
+
+/**
+ * @brief Phong Shading for four fragments at once
+ * 
+ * The per-pixel cost of computePhongShading is dominated by three
+ * normalizations (each a square root and a division) and std::pow. Here the
+ * fragments are laid out structure-of-arrays, one register per component,
+ * so every operation lights four pixels: normalizations use rsqrt plus a
+ * Newton step, and the specular power uses fastPow4. Results match the
+ * scalar version to within one 8-bit color step.
+ */
+void Shaders::computePhongShading4(const __m128 fragPos[3], const __m128 normal[3],
+                                   const glm::vec3& viewPos, const Light& light,
+                                   const Material& material, __m128 rgb[3]) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    
+    __m128 norm[3] = {normal[0], normal[1], normal[2]};
+    __m128 lightDir[3];
+    __m128 viewDir[3];
+    for (int k = 0; k < 3; ++k) {
+        lightDir[k] = _mm_sub_ps(_mm_set1_ps(light.position[k]), fragPos[k]);
+        viewDir[k] = _mm_sub_ps(_mm_set1_ps(viewPos[k]), fragPos[k]);
+    }
+    normalize4(norm);
+    normalize4(lightDir);
+    normalize4(viewDir);
+    
+    // Blinn-Phong: halfway vector between light and view direction
+    __m128 halfwayDir[3];
+    for (int k = 0; k < 3; ++k) {
+        halfwayDir[k] = _mm_add_ps(lightDir[k], viewDir[k]);
+    }
+    normalize4(halfwayDir);
+    
+    // max(x, 0) with x first also maps NaN (zero-length vectors) to 0
+    __m128 diff = _mm_max_ps(dot4(norm, lightDir), zero);
+    __m128 spec = fastPow4(_mm_max_ps(dot4(norm, halfwayDir), zero), material.shininess);
+    
+    // ambient + diffuse * diff + specular * spec, clamped to [0, 1]
+    glm::vec3 ambient = calculateAmbient(light, material);
+    glm::vec3 diffuse = light.color * material.diffuse;
+    glm::vec3 specular = light.color * material.specular;
+    for (int k = 0; k < 3; ++k) {
+        __m128 color = _mm_add_ps(_mm_set1_ps(ambient[k]), 
+                                  _mm_add_ps(_mm_mul_ps(_mm_set1_ps(diffuse[k]), diff),
+                                             _mm_mul_ps(_mm_set1_ps(specular[k]), spec)));
+        rgb[k] = _mm_min_ps(_mm_max_ps(color, zero), one);
+    }
+}
+
+/**
+ * @brief Approximates pow(base, exponent) on four lanes for base in [0, 1]
+ * 
+ * pow(x, e) = exp2(e * log2(x)). log2 splits x into its float exponent and
+ * a mantissa m in [sqrt(1/2), sqrt(2)), where log2(m) converges quickly as
+ * the series 2 / ln(2) * (s + s^3 / 3 + s^5 / 5 + s^7 / 7), s = (m - 1) / (m + 1).
+ * exp2 splits its argument into the nearest integer, added straight to the
+ * exponent bits, and a fraction in [-1/2, 1/2] evaluated with a degree-5
+ * Taylor polynomial. The relative error stays around 1e-5 for the
+ * shininess values used here. Lanes with base <= 0 return 0.
+ */
+__m128 Shaders::fastPow4(__m128 base, float exponent) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    
+    // log2(x) = exponent + log2(mantissa), mantissa normalized around 1
+    __m128i bits = _mm_castps_si128(base);
+    __m128i e = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+    __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)),
+                                             _mm_castps_si128(one)));
+    __m128 large = _mm_cmpgt_ps(m, _mm_set1_ps(1.41421356f));
+    m = _mm_or_ps(_mm_and_ps(large, _mm_mul_ps(m, _mm_set1_ps(0.5f))), _mm_andnot_ps(large, m));
+    e = _mm_sub_epi32(e, _mm_castps_si128(large));  // Mask is -1: exponent + 1
+    
+    __m128 s = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+    __m128 s2 = _mm_mul_ps(s, s);
+    __m128 series = _mm_add_ps(_mm_set1_ps(1.0f / 5.0f), _mm_mul_ps(s2, _mm_set1_ps(1.0f / 7.0f)));
+    series = _mm_add_ps(_mm_set1_ps(1.0f / 3.0f), _mm_mul_ps(s2, series));
+    series = _mm_add_ps(one, _mm_mul_ps(s2, series));
+    __m128 log2x = _mm_add_ps(_mm_cvtepi32_ps(e), 
+                              _mm_mul_ps(_mm_set1_ps(2.88539008f), _mm_mul_ps(s, series)));
+    
+    // exp2(y) = 2^i * exp2(f) with i = round(y); clamped to stay a normal float
+    __m128 y = _mm_max_ps(_mm_mul_ps(log2x, _mm_set1_ps(exponent)), _mm_set1_ps(-126.0f));
+    __m128i i = _mm_cvtps_epi32(y);
+    __m128 f = _mm_sub_ps(y, _mm_cvtepi32_ps(i));
+    
+    __m128 p = _mm_set1_ps(1.33335581e-3f);
+    p = _mm_add_ps(_mm_set1_ps(9.61812911e-3f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(5.55041087e-2f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(2.40226507e-1f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(_mm_set1_ps(6.93147181e-1f), _mm_mul_ps(f, p));
+    p = _mm_add_ps(one, _mm_mul_ps(f, p));
+    __m128 result = _mm_castsi128_ps(_mm_add_epi32(_mm_castps_si128(p), _mm_slli_epi32(i, 23)));
+    
+    return _mm_and_ps(result, _mm_cmpgt_ps(base, _mm_setzero_ps()));
+}
+#endif
+
 /**
  * @brief Calculates the ambient lighting component
  * 
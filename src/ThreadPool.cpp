@@ -0,0 +1,95 @@
+#include "ThreadPool.h"
+
+/**
+ * @brief Constructor - Starts threadCount - 1 worker threads
+ */
+ThreadPool::ThreadPool(int threadCount)
+    : currentJob(nullptr), jobCount(0), nextJob(0), activeWorkers(0), 
+      generation(0), stopping(false) {
+    for (int i = 1; i < threadCount; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+/**
+ * @brief Destructor - Wakes all workers and joins them
+ */
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+    
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+/**
+ * @brief Executes job(i) for every i in [0, count) and blocks until all are done
+ * 
+ * Jobs are handed out through an atomic counter, so threads that finish
+ * early keep pulling work instead of waiting on a fixed partition.
+ */
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& job) {
+    if (count <= 0) return;
+    
+    if (workers.empty()) {
+        for (int i = 0; i < count; ++i) {
+            job(i);
+        }
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentJob = &job;
+        jobCount = count;
+        nextJob = 0;
+        activeWorkers = static_cast<int>(workers.size());
+        ++generation;
+    }
+    wakeCondition.notify_all();
+    
+    // The calling thread works too
+    runJobs();
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [this] { return activeWorkers == 0; });
+    currentJob = nullptr;
+}
+
+/**
+ * @brief Main loop of a worker thread
+ */
+void ThreadPool::workerLoop() {
+    unsigned int seenGeneration = 0;
+    
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeCondition.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping) return;
+            seenGeneration = generation;
+        }
+        
+        runJobs();
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--activeWorkers == 0) {
+            doneCondition.notify_one();
+        }
+    }
+}
+
+/**
+ * @brief Pulls job indices until the current batch is exhausted
+ */
+void ThreadPool::runJobs() {
+    while (true) {
+        int index = nextJob.fetch_add(1);
+        if (index >= jobCount) break;
+        (*currentJob)(index);
+    }
+}
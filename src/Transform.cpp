@@ -1,10 +1,11 @@
 #include "Transform.h"
 #include <glm/gtc/matrix_transform.hpp>
+#include "Simd.h"
 
 /**
  * @brief Constructor - Initializes all matrices to identity
  */
-Transform::Transform() {
+Transform::Transform() : staleMatrices(DERIVED_ALL), guardBand(16.0f) {
     modelMatrix = glm::mat4(1.0f);
     viewMatrix = glm::mat4(1.0f);
     projectionMatrix = glm::mat4(1.0f);
@@ -12,9 +13,14 @@ Transform::Transform() {
 
 /**
  * @brief Sets the model transformation matrix
+ * 
+ * The three setters are the only writers of the matrices (the camera
+ * helpers and the matrix stack go through them), so they alone mark the
+ * cached derived matrices stale.
  */
 void Transform::setModelMatrix(const glm::mat4& model) {
     modelMatrix = model;
+    staleMatrices = DERIVED_ALL;
 }
 
 /**
@@ -22,6 +28,7 @@ void Transform::setModelMatrix(const glm::mat4& model) {
  */
 void Transform::setViewMatrix(const glm::mat4& view) {
     viewMatrix = view;
+    staleMatrices |= DERIVED_MVP | DERIVED_MODEL_VIEW | DERIVED_NORMAL;
 }
 
 /**
@@ -29,6 +36,7 @@ void Transform::setViewMatrix(const glm::mat4& view) {
  */
 void Transform::setProjectionMatrix(const glm::mat4& projection) {
     projectionMatrix = projection;
+    staleMatrices |= DERIVED_MVP;
 }
 
 /**
@@ -94,7 +102,7 @@ glm::mat4 Transform::createScaleMatrix(float sx, float sy, float sz) {
  * @param up Up vector defining camera orientation
  */
 void Transform::setLookAt(const glm::vec3& eye, const glm::vec3& center, const glm::vec3& up) {
-    viewMatrix = glm::lookAt(eye, center, up);
+    setViewMatrix(glm::lookAt(eye, center, up));
 }
 
 /**
@@ -109,7 +117,7 @@ void Transform::setLookAt(const glm::vec3& eye, const glm::vec3& center, const g
  * @param far Distance to far clipping plane
  */
 void Transform::setPerspective(float fovy, float aspect, float near, float far) {
-    projectionMatrix = glm::perspective(fovy, aspect, near, far);
+    setProjectionMatrix(glm::perspective(fovy, aspect, near, far));
 }
 
 /**
@@ -127,7 +135,7 @@ void Transform::setPerspective(float fovy, float aspect, float near, float far)
  */
 void Transform::setOrthographic(float left, float right, float bottom, float top, 
                                 float near, float far) {
-    projectionMatrix = glm::ortho(left, right, bottom, top, near, far);
+    setProjectionMatrix(glm::ortho(left, right, bottom, top, near, far));
 }
 
 /**
@@ -143,7 +151,7 @@ void Transform::setOrthographic(float left, float right, float bottom, float top
  * @return Transformed vertex in clip space
  */
 glm::vec4 Transform::transformVertex(const glm::vec4& vertex) const {
-    return projectionMatrix * viewMatrix * modelMatrix * vertex;
+    return getMVPMatrix() * vertex;
 }
 
 /**
@@ -156,16 +164,220 @@ glm::vec4 Transform::transformVertex(const glm::vec4& vertex) const {
  * @return Transformed normal in view space
  */
 glm::vec3 Transform::transformNormal(const glm::vec3& normal) const {
-    glm::mat3 normalMatrix = getNormalMatrix();
-    return glm::normalize(normalMatrix * normal);
+    return glm::normalize(getNormalMatrix() * normal);
+}
+
+/**
+ * @brief Combined model-view-projection matrix, recomputed only when stale
+ */
+const glm::mat4& Transform::getMVPMatrix() const {
+    if (staleMatrices & DERIVED_MVP) {
+        mvpMatrix = projectionMatrix * viewMatrix * modelMatrix;
+        staleMatrices &= ~DERIVED_MVP;
+    }
+    return mvpMatrix;
+}
+
+/**
+ * @brief Combined model-view matrix, recomputed only when stale
+ */
+const glm::mat4& Transform::getModelViewMatrix() const {
+    if (staleMatrices & DERIVED_MODEL_VIEW) {
+        modelViewMatrix = viewMatrix * modelMatrix;
+        staleMatrices &= ~DERIVED_MODEL_VIEW;
+    }
+    return modelViewMatrix;
+}
+
+/**
+ * @brief Normal matrix (inverse transpose of the model-view matrix)
+ * 
+ * The 3x3 inverse is the expensive part, so it is only redone after the
+ * model or view matrix changes.
+ */
+const glm::mat3& Transform::getNormalMatrix() const {
+    if (staleMatrices & DERIVED_NORMAL) {
+        normalMatrix = glm::transpose(glm::inverse(glm::mat3(getModelViewMatrix())));
+        staleMatrices &= ~DERIVED_NORMAL;
+    }
+    return normalMatrix;
+}
+
+/**
+ * @brief World space normal matrix (inverse transpose of the model matrix)
+ * 
+ * Used for lighting in world space, where normals only go through the model
+ * transform.
+ */
+const glm::mat3& Transform::getModelNormalMatrix() const {
+    if (staleMatrices & DERIVED_MODEL_NORMAL) {
+        modelNormalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
+        staleMatrices &= ~DERIVED_MODEL_NORMAL;
+    }
+    return modelNormalMatrix;
+}
+
+#ifdef LUMINA_SSE2
+/**
+ * @brief Stores four SoA positions as four consecutive glm::vec4
+ */
+static inline void storeTransposed4(glm::vec4* out, __m128 x, __m128 y, __m128 z, __m128 w) {
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    float* target = &out[0].x;
+    _mm_storeu_ps(target + 0, x);
+    _mm_storeu_ps(target + 4, y);
+    _mm_storeu_ps(target + 8, z);
+    _mm_storeu_ps(target + 12, w);
 }
+#endif
 
+#ifdef LUMINA_AVX2
 /**
- * @brief Computes the normal matrix (inverse transpose of model-view matrix)
+ * @brief Stores eight SoA positions as eight consecutive glm::vec4
  */
-glm::mat3 Transform::getNormalMatrix() const {
-    glm::mat4 modelView = viewMatrix * modelMatrix;
-    return glm::transpose(glm::inverse(glm::mat3(modelView)));
+static inline void storeTransposed8(glm::vec4* out, __m256 x, __m256 y, __m256 z, __m256 w) {
+    // Each 128-bit half is transposed on its own: vertices 0-3 and 4-7
+    __m256 xy0 = _mm256_unpacklo_ps(x, y);   // x0 y0 x1 y1 | x4 y4 x5 y5
+    __m256 xy1 = _mm256_unpackhi_ps(x, y);   // x2 y2 x3 y3 | x6 y6 x7 y7
+    __m256 zw0 = _mm256_unpacklo_ps(z, w);
+    __m256 zw1 = _mm256_unpackhi_ps(z, w);
+    __m256 v0 = _mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(1, 0, 1, 0));  // vertex 0 | 4
+    __m256 v1 = _mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(3, 2, 3, 2));  // vertex 1 | 5
+    __m256 v2 = _mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(1, 0, 1, 0));  // vertex 2 | 6
+    __m256 v3 = _mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(3, 2, 3, 2));  // vertex 3 | 7
+    
+    float* target = &out[0].x;
+    _mm256_storeu_ps(target + 0, _mm256_permute2f128_ps(v0, v1, 0x20));
+    _mm256_storeu_ps(target + 8, _mm256_permute2f128_ps(v2, v3, 0x20));
+    _mm256_storeu_ps(target + 16, _mm256_permute2f128_ps(v0, v1, 0x31));
+    _mm256_storeu_ps(target + 24, _mm256_permute2f128_ps(v2, v3, 0x31));
+}
+#endif
+
+/**
+ * @brief Transforms a batch of model-space positions to clip and screen space
+ * 
+ * The model-view-projection matrix is multiplied once for the batch, not
+ * once per vertex. Vertices are then processed 8 at a time with AVX2 (4 with
+ * SSE2): each lane computes its clip position, divides by w and maps the
+ * result to the viewport, and the lanes are transposed into glm::vec4 only
+ * for the stores. The sums are associated as in glm's mat4 * vec4 and every
+ * operation rounds like transformVertex() followed by the division and
+ * viewportTransform(), so both paths give identical positions.
+ * 
+ * Vertices with w <= 0 get a zero screen position, as their division would
+ * give nothing meaningful (or infinities); such vertices are only usable
+ * through clipTriangle().
+ * 
+ * @param x, y, z Model-space coordinates, count values each
+ * @param clipPositions Receives count clip-space positions
+ * @param screenPositions Receives count (screen x, screen y, NDC z, 1/w)
+ */
+void Transform::transformVertices(const float* x, const float* y, const float* z, int count,
+                                  int screenWidth, int screenHeight,
+                                  glm::vec4* clipPositions, glm::vec4* screenPositions) const {
+    const glm::mat4 mvp = getMVPMatrix();
+    int i = 0;
+    
+#ifdef LUMINA_AVX2
+    {
+        __m256 m[4][4];
+        for (int c = 0; c < 4; ++c) {
+            for (int r = 0; r < 4; ++r) {
+                m[c][r] = _mm256_set1_ps(mvp[c][r]);
+            }
+        }
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 widthV = _mm256_set1_ps(static_cast<float>(screenWidth));
+        const __m256 heightV = _mm256_set1_ps(static_cast<float>(screenHeight));
+        
+        for (; i + 8 <= count; i += 8) {
+            __m256 px = _mm256_loadu_ps(x + i);
+            __m256 py = _mm256_loadu_ps(y + i);
+            __m256 pz = _mm256_loadu_ps(z + i);
+            
+            // Same association as glm's mat4 * vec4: (c0 x + c1 y) + (c2 z + c3 w)
+            __m256 clip[4];
+            for (int r = 0; r < 4; ++r) {
+                clip[r] = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(m[0][r], px), _mm256_mul_ps(m[1][r], py)),
+                    _mm256_add_ps(_mm256_mul_ps(m[2][r], pz), m[3][r]));
+            }
+            
+            // Perspective division and viewport transform
+            __m256 ndcX = _mm256_div_ps(clip[0], clip[3]);
+            __m256 ndcY = _mm256_div_ps(clip[1], clip[3]);
+            __m256 ndcZ = _mm256_div_ps(clip[2], clip[3]);
+            __m256 screenX = _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(ndcX, one), half), widthV);
+            __m256 screenY = _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(one, ndcY), half), heightV);
+            __m256 invW = _mm256_div_ps(one, clip[3]);
+            
+            // Lanes behind the eye store zero
+            __m256 front = _mm256_cmp_ps(clip[3], zero, _CMP_GT_OQ);
+            storeTransposed8(clipPositions + i, clip[0], clip[1], clip[2], clip[3]);
+            storeTransposed8(screenPositions + i, _mm256_and_ps(screenX, front), 
+                             _mm256_and_ps(screenY, front), _mm256_and_ps(ndcZ, front), 
+                             _mm256_and_ps(invW, front));
+        }
+    }
+#endif
+    
+#ifdef LUMINA_SSE2
+    {
+        __m128 m[4][4];
+        for (int c = 0; c < 4; ++c) {
+            for (int r = 0; r < 4; ++r) {
+                m[c][r] = _mm_set1_ps(mvp[c][r]);
+            }
+        }
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 widthV = _mm_set1_ps(static_cast<float>(screenWidth));
+        const __m128 heightV = _mm_set1_ps(static_cast<float>(screenHeight));
+        
+        for (; i + 4 <= count; i += 4) {
+            __m128 px = _mm_loadu_ps(x + i);
+            __m128 py = _mm_loadu_ps(y + i);
+            __m128 pz = _mm_loadu_ps(z + i);
+            
+            __m128 clip[4];
+            for (int r = 0; r < 4; ++r) {
+                clip[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][r], px), _mm_mul_ps(m[1][r], py)),
+                                     _mm_add_ps(_mm_mul_ps(m[2][r], pz), m[3][r]));
+            }
+            
+            __m128 ndcX = _mm_div_ps(clip[0], clip[3]);
+            __m128 ndcY = _mm_div_ps(clip[1], clip[3]);
+            __m128 ndcZ = _mm_div_ps(clip[2], clip[3]);
+            __m128 screenX = _mm_mul_ps(_mm_mul_ps(_mm_add_ps(ndcX, one), half), widthV);
+            __m128 screenY = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(one, ndcY), half), heightV);
+            __m128 invW = _mm_div_ps(one, clip[3]);
+            
+            // Lanes behind the eye store zero
+            __m128 front = _mm_cmpgt_ps(clip[3], zero);
+            storeTransposed4(clipPositions + i, clip[0], clip[1], clip[2], clip[3]);
+            storeTransposed4(screenPositions + i, _mm_and_ps(screenX, front), 
+                             _mm_and_ps(screenY, front), _mm_and_ps(ndcZ, front), 
+                             _mm_and_ps(invW, front));
+        }
+    }
+#endif
+    
+    // Scalar loop: remaining vertices (or all of them without SIMD)
+    for (; i < count; ++i) {
+        glm::vec4 clip = mvp * glm::vec4(x[i], y[i], z[i], 1.0f);
+        clipPositions[i] = clip;
+        if (clip.w > 0.0f) {
+            glm::vec4 ndc = clip / clip.w;
+            glm::vec2 screen = viewportTransform(ndc, screenWidth, screenHeight);
+            screenPositions[i] = glm::vec4(screen.x, screen.y, ndc.z, 1.0f / clip.w);
+        } else {
+            screenPositions[i] = glm::vec4(0.0f);
+        }
+    }
 }
 
 /**
@@ -289,6 +501,129 @@ int Transform::computeOutCode(float x, float y, float xMin, float yMin,
     return code;
 }
 
+/**
+ * @brief Sutherland-Hodgman Triangle Clipping in homogeneous clip space
+ * 
+ * Clipping happens before the perspective division, where every frustum
+ * plane is linear in (x, y, z, w):
+ *   near: z >= -w      far: z <= w
+ *   left/right: |x| <= g * w      bottom/top: |y| <= g * w
+ * 
+ * The side planes use the guard band g instead of the viewport edges
+ * (g = 1). The rasterizer already clips to the screen for free, so a
+ * triangle that merely overlaps the viewport edge is drawn unclipped. Only
+ * triangles crossing the near or far plane (whose projection would be
+ * inverted or infinite) or leaving the guard band (whose screen coordinates
+ * would overflow the rasterizer's fixed-point range) go through the
+ * clipper.
+ * 
+ * Sutherland-Hodgman clips the polygon against one plane at a time,
+ * keeping inside vertices and inserting the intersection wherever an edge
+ * crosses the plane. Intersections are always interpolated from the inside
+ * vertex towards the outside one, so an edge shared by two triangles is
+ * split at exactly the same point.
+ * 
+ * @param v1, v2, v3 Triangle vertices in clip space
+ * @param polygon Receives the clipped polygon when TRIANGLE_CLIPPED is returned
+ * @return Whether the triangle is rejected, accepted unchanged, or clipped
+ */
+TriangleClipResult Transform::clipTriangle(const glm::vec4& v1, const glm::vec4& v2, 
+                                           const glm::vec4& v3, ClippedPolygon& polygon) const {
+    // Trivial reject: all vertices outside the same plane of the view frustum
+    if (computeClipCode(v1, 1.0f) & computeClipCode(v2, 1.0f) & computeClipCode(v3, 1.0f)) {
+        return TRIANGLE_REJECTED;
+    }
+    
+    // Trivial accept: all vertices inside the near/far planes and the guard band
+    int clipMask = computeClipCode(v1, guardBand) | computeClipCode(v2, guardBand) | 
+                   computeClipCode(v3, guardBand);
+    if (clipMask == INSIDE) {
+        return TRIANGLE_ACCEPTED;
+    }
+    
+    // Plane coefficients p such that dot(p, v) >= 0 on the inside
+    const int planeCodes[6] = {LEFT, RIGHT, BOTTOM, TOP, NEAR_PLANE, FAR_PLANE};
+    const glm::vec4 planes[6] = {
+        glm::vec4(1.0f, 0.0f, 0.0f, guardBand),
+        glm::vec4(-1.0f, 0.0f, 0.0f, guardBand),
+        glm::vec4(0.0f, 1.0f, 0.0f, guardBand),
+        glm::vec4(0.0f, -1.0f, 0.0f, guardBand),
+        glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),
+        glm::vec4(0.0f, 0.0f, -1.0f, 1.0f)
+    };
+    
+    polygon.count = 3;
+    polygon.position[0] = v1;
+    polygon.position[1] = v2;
+    polygon.position[2] = v3;
+    polygon.weights[0] = glm::vec3(1.0f, 0.0f, 0.0f);
+    polygon.weights[1] = glm::vec3(0.0f, 1.0f, 0.0f);
+    polygon.weights[2] = glm::vec3(0.0f, 0.0f, 1.0f);
+    
+    for (int p = 0; p < 6; ++p) {
+        if (!(clipMask & planeCodes[p])) continue;
+        
+        ClippedPolygon input = polygon;
+        polygon.count = 0;
+        
+        for (int i = 0; i < input.count; ++i) {
+            int j = (i + 1) % input.count;
+            float di = glm::dot(planes[p], input.position[i]);
+            float dj = glm::dot(planes[p], input.position[j]);
+            
+            if (di >= 0.0f) {
+                polygon.position[polygon.count] = input.position[i];
+                polygon.weights[polygon.count] = input.weights[i];
+                ++polygon.count;
+            }
+            
+            if ((di >= 0.0f) != (dj >= 0.0f)) {
+                // Edge crosses the plane: interpolate from the inside vertex
+                int in = di >= 0.0f ? i : j;
+                int out = di >= 0.0f ? j : i;
+                float dIn = di >= 0.0f ? di : dj;
+                float dOut = di >= 0.0f ? dj : di;
+                float t = dIn / (dIn - dOut);
+                
+                polygon.position[polygon.count] = input.position[in] + 
+                    (input.position[out] - input.position[in]) * t;
+                polygon.weights[polygon.count] = input.weights[in] + 
+                    (input.weights[out] - input.weights[in]) * t;
+                ++polygon.count;
+            }
+        }
+        
+        if (polygon.count < 3) {
+            return TRIANGLE_REJECTED;
+        }
+    }
+    
+    return TRIANGLE_CLIPPED;
+}
+
+/**
+ * @brief Computes the clip code of a vertex in homogeneous clip space
+ * 
+ * The side planes are tested against band * w (1.0 = view frustum, larger
+ * values = guard band); near and far are always the frustum planes. Every
+ * plane is a linear test in (x, y, z, w), so a vertex interpolated between
+ * vertices inside a plane is inside it too: clipping against the planes in
+ * the combined code of the three input vertices is sufficient.
+ */
+int Transform::computeClipCode(const glm::vec4& v, float band) const {
+    // Independent tests: with w < 0 a vertex can be outside opposite planes
+    int code = INSIDE;
+    
+    if (v.x < -band * v.w) code |= LEFT;
+    if (v.x > band * v.w) code |= RIGHT;
+    if (v.y < -band * v.w) code |= BOTTOM;
+    if (v.y > band * v.w) code |= TOP;
+    if (v.z < -v.w) code |= NEAR_PLANE;
+    if (v.z > v.w) code |= FAR_PLANE;
+    
+    return code;
+}
+
 /**
  * @brief Pushes the current model matrix onto the stack
  * 
@@ -303,7 +638,7 @@ void Transform::pushMatrix() {
  */
 void Transform::popMatrix() {
     if (!matrixStack.empty()) {
-        modelMatrix = matrixStack.back();
+        setModelMatrix(matrixStack.back());
         matrixStack.pop_back();
     }
 }
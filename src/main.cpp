@@ -16,7 +16,11 @@ Engine::Engine()
       rotationX(0.0f), 
       rotationY(0.0f), 
       rotationZ(0.0f), 
-      scale(1.0f) {
+      scale(1.0f), modelMatrixDirty(true),
+      shadingModel(SHADING_GOURAUD), cullMode(CULL_BACK), 
+      depthPrepass(false), deferMoonLighting(false),
+      moonLatSegments(256), moonLonSegments(256), moonRadius(2.0f), moonMeshDirty(true),
+      craterSeed(1), craterCount(1500), craterMinRadius(0.03f), craterMaxRadius(0.5f) {
     g_engine = this;
 }
 
@@ -64,6 +68,7 @@ bool Engine::initialize() {
     
     // Initialize subsystems
     rasterizer = new Rasterizer(VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+    rasterizer->setThreadCount(0);  // One rasterizer thread per hardware thread
     transform = new Transform();
     
     // Setup default scene
@@ -82,9 +87,20 @@ bool Engine::initialize() {
     std::cout << "OpenGL Renderer: " << glGetString(GL_RENDERER) << std::endl;
     
     std::cout << "Lumina3D Engine Initialized" << std::endl;
+    std::cout << "Rasterizer threads: " << rasterizer->getThreadCount() << std::endl;
     std::cout << "Controls:" << std::endl;
     std::cout << "  Arrow Keys: Rotate object" << std::endl;
     std::cout << "  +/- : Scale object" << std::endl;
+    std::cout << "  T : Toggle raster mode (edge function / scanline)" << std::endl;
+    std::cout << "  V : Toggle visibility buffer (deferred shading)" << std::endl;
+    std::cout << "  P : Toggle Gouraud / Phong shading" << std::endl;
+    std::cout << "  C : Cycle moon face culling (back / front / none)" << std::endl;
+    std::cout << "  M : Toggle 4x MSAA" << std::endl;
+    std::cout << "  Z : Cycle depth buffer format (float32 / unorm24 / unorm16)" << std::endl;
+    std::cout << "  H : Print last frame's triangle size histogram" << std::endl;
+    std::cout << "  A : Toggle sort-last (atomic) / tile-binned parallel rasterization" << std::endl;
+    std::cout << "  D : Toggle depth prepass (light visible moon triangles only)" << std::endl;
+    std::cout << "  N : Generate a new crater field" << std::endl;
     std::cout << "  R : Reset transformations" << std::endl;
     std::cout << "  ESC : Exit" << std::endl;
     
@@ -162,18 +178,32 @@ void Engine::setupDefaultScene() {
     lightPos = glm::vec3(5.0f, 3.0f, 5.0f);
     lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
     ambientColor = glm::vec3(0.3f, 0.3f, 0.3f);
+    
+    // Moon lighting
+    moonLight.position = lightPos;
+    moonLight.color = lightColor;
+    moonLight.ambient = ambientColor;
+    
+    moonMaterial.ambient = glm::vec3(0.12f, 0.12f, 0.11f);  // Dark ambient for space
+    moonMaterial.diffuse = glm::vec3(0.75f, 0.72f, 0.68f);  // Realistic lunar regolith gray
+    moonMaterial.specular = glm::vec3(0.05f, 0.05f, 0.05f); // Moon is very matte
+    moonMaterial.shininess = 4.0f;                           // Very low shininess
 }
 
 /**
  * @brief Update loop - updates transformations
  */
 void Engine::update(float deltaTime) {
+    // Setting the model matrix invalidates Transform's cached matrices, so
+    // only do it when the rotation or scale changed
+    if (!modelMatrixDirty) return;
+    
     // Create model matrix with current transformations
     glm::mat4 model = glm::mat4(1.0f);
     model = transform->createScaleMatrix(scale, scale, scale) * model;
     model = transform->createRotationMatrix(rotationX, rotationY, rotationZ) * model;
-    
     transform->setModelMatrix(model);
+    modelMatrixDirty = false;
 }
 
 /**
@@ -199,11 +229,18 @@ void Engine::render() {
     // Render software rasterized scene
     rasterizer->clearBuffers(Color(0, 0, 0, 255));
     renderScene();
+    rasterizer->flush();
+    
+    // Deferred shading: light each visible pixel exactly once
+    if (rasterizer->getVisibilityBuffer()) {
+        rasterizer->resolveVisibilityBuffer(shadingModel, moonLight, moonMaterial, cameraPos);
+    }
     
-    // Upload framebuffer to texture
+    // Upload framebuffer to texture (either pixel format is uploaded as-is)
+    GLenum pixelFormat = rasterizer->getPixelFormat() == PIXEL_RGBA8 ? GL_RGBA : GL_RGB;
     glBindTexture(GL_TEXTURE_2D, frameTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, 
-                 0, GL_RGB, GL_UNSIGNED_BYTE, rasterizer->getFrameBuffer());
+    glTexImage2D(GL_TEXTURE_2D, 0, pixelFormat, VIEWPORT_WIDTH, VIEWPORT_HEIGHT, 
+                 0, pixelFormat, GL_UNSIGNED_BYTE, rasterizer->getFrameBuffer());
     
     // Draw textured quad on right side
     glEnable(GL_TEXTURE_2D);
@@ -320,91 +357,12 @@ void Engine::drawLightTriangle(const glm::vec4& v1, const glm::vec4& v2, const g
 
 /**
  * @brief Generates crater displacement for moon surface
+ * 
+ * The craters come from craterField, which only evaluates the craters near
+ * (theta, phi); the regolith roughness is added on top.
  */
 float Engine::generateCraterDisplacement(float theta, float phi) {
-    // Realistic crater data: {theta, phi, radius, depth}
-    // Many craters of varying sizes for realistic moon surface
-    struct Crater {
-        float theta, phi, radius, depth;
-    };
-    
-    // Large impact basins (maria-like)
-    static const Crater craters[] = {
-        // Large craters
-        {0.5f, 0.8f, 0.45f, 0.20f},
-        {1.5f, -0.7f, 0.50f, 0.22f},
-        {2.2f, 2.5f, 0.40f, 0.18f},
-        {0.8f, -2.0f, 0.38f, 0.17f},
-        {2.8f, 1.0f, 0.42f, 0.19f},
-        // Medium craters
-        {2.0f, 1.5f, 0.28f, 0.13f},
-        {1.0f, 0.5f, 0.22f, 0.11f},
-        {0.2f, -0.3f, 0.25f, 0.12f},
-        {1.8f, -1.8f, 0.30f, 0.14f},
-        {2.5f, 0.2f, 0.20f, 0.10f},
-        {0.7f, 3.0f, 0.26f, 0.12f},
-        {1.2f, -2.8f, 0.24f, 0.11f},
-        {2.6f, -1.2f, 0.22f, 0.10f},
-        {0.4f, 2.2f, 0.27f, 0.13f},
-        {1.9f, 0.0f, 0.23f, 0.11f},
-        // Small craters
-        {0.8f, -1.2f, 0.15f, 0.07f},
-        {1.3f, 2.0f, 0.14f, 0.06f},
-        {2.4f, -0.5f, 0.16f, 0.07f},
-        {0.3f, 1.5f, 0.13f, 0.06f},
-        {1.7f, -2.5f, 0.17f, 0.08f},
-        {2.9f, 2.8f, 0.15f, 0.07f},
-        {0.6f, -0.8f, 0.12f, 0.05f},
-        {1.1f, 1.2f, 0.18f, 0.08f},
-        {2.1f, -1.5f, 0.14f, 0.06f},
-        {0.9f, 2.7f, 0.16f, 0.07f},
-        // Tiny craters (surface detail)
-        {0.35f, 0.4f, 0.08f, 0.03f},
-        {1.45f, -1.0f, 0.09f, 0.04f},
-        {2.15f, 1.8f, 0.07f, 0.03f},
-        {0.75f, -2.3f, 0.10f, 0.04f},
-        {1.85f, 0.7f, 0.08f, 0.03f},
-        {2.55f, -2.0f, 0.09f, 0.04f},
-        {0.15f, 1.0f, 0.07f, 0.03f},
-        {1.65f, 2.3f, 0.10f, 0.04f},
-        {2.35f, 0.5f, 0.06f, 0.02f},
-        {0.55f, -1.5f, 0.08f, 0.03f},
-        {1.25f, -0.2f, 0.07f, 0.03f},
-        {2.75f, 1.5f, 0.09f, 0.04f},
-        {0.45f, -2.7f, 0.06f, 0.02f},
-        {1.55f, 0.3f, 0.08f, 0.03f},
-        {2.05f, -0.8f, 0.07f, 0.03f},
-        {0.85f, 2.0f, 0.10f, 0.04f},
-    };
-    
-    const int numCraters = sizeof(craters) / sizeof(craters[0]);
-    float displacement = 0.0f;
-    
-    for (int i = 0; i < numCraters; ++i) {
-        const Crater& crater = craters[i];
-        float dTheta = theta - crater.theta;
-        float dPhi = phi - crater.phi;
-        float dist = std::sqrt(dTheta * dTheta + dPhi * dPhi);
-        
-        if (dist < crater.radius * 1.3f) {
-            float normalized = dist / crater.radius;
-            
-            if (normalized <= 1.0f) {
-                // Inside crater: bowl shape with flat floor
-                float bowlProfile = crater.depth * (0.5f * std::cos(normalized * 3.14159f) + 0.5f);
-                // Flatten the center slightly for realism
-                float flattenFactor = 1.0f - 0.3f * std::exp(-normalized * normalized * 8.0f);
-                displacement -= bowlProfile * flattenFactor;
-            }
-            
-            // Raised crater rim
-            if (normalized > 0.75f && normalized < 1.3f) {
-                float rimDist = std::abs(normalized - 1.0f);
-                float rimHeight = crater.depth * 0.35f * std::exp(-rimDist * rimDist * 25.0f);
-                displacement += rimHeight;
-            }
-        }
-    }
+    float displacement = craterField.displacement(theta, phi);
     
     // Multi-scale surface roughness for realistic regolith texture
     // Large-scale terrain undulation
@@ -422,111 +380,286 @@ float Engine::generateCraterDisplacement(float theta, float phi) {
 }
 
 /**
- * @brief Draws a moon sphere with craters using manual triangle rasterization
+ * @brief Builds the cached moon mesh: a displaced latitude/longitude grid
+ * 
+ * The sphere's (lat + 1) x (lon + 1) grid vertices are each computed once
+ * and shared by the up to six triangles around them, so the crater field
+ * is evaluated once per vertex rather than four times per quad. The first
+ * and last longitude columns stay separate vertices, like the pole rows, as
+ * the surface roughness is not periodic in phi.
  */
-void Engine::drawMoon() {
-    const int latSegments = 256;  // High resolution latitude divisions
-    const int lonSegments = 256;  // High resolution longitude divisions
-    const float radius = 2.0f;
-    
-    // Setup lighting
-    Light light;
-    light.position = lightPos;
-    light.color = lightColor;
-    light.ambient = ambientColor;
-    
-    Material material;
-    material.ambient = glm::vec3(0.12f, 0.12f, 0.11f);  // Dark ambient for space
-    material.diffuse = glm::vec3(0.75f, 0.72f, 0.68f);  // Realistic lunar regolith gray
-    material.specular = glm::vec3(0.05f, 0.05f, 0.05f); // Moon is very matte
-    material.shininess = 4.0f;                           // Very low shininess
-    
-    // Generate sphere with craters
-    for (int lat = 0; lat < latSegments; ++lat) {
-        for (int lon = 0; lon < lonSegments; ++lon) {
+void Engine::buildMoonMesh() {
+    craterField.generate(craterSeed, craterCount, craterMinRadius, craterMaxRadius);
+    
+    int columns = moonLonSegments + 1;
+    int vertexCount = (moonLatSegments + 1) * columns;
+    
+    moonMeshX.clear();
+    moonMeshY.clear();
+    moonMeshZ.clear();
+    moonMeshNormals.clear();
+    moonMeshIndices.clear();
+    moonMeshX.reserve(vertexCount);
+    moonMeshY.reserve(vertexCount);
+    moonMeshZ.reserve(vertexCount);
+    moonMeshNormals.reserve(vertexCount);
+    moonMeshIndices.reserve(moonLatSegments * moonLonSegments * 6);
+    
+    for (int lat = 0; lat <= moonLatSegments; ++lat) {
+        for (int lon = 0; lon <= moonLonSegments; ++lon) {
             // Calculate angles
-            float theta1 = lat * 3.14159f / latSegments;
-            float theta2 = (lat + 1) * 3.14159f / latSegments;
-            float phi1 = lon * 2.0f * 3.14159f / lonSegments;
-            float phi2 = (lon + 1) * 2.0f * 3.14159f / lonSegments;
+            float theta = lat * 3.14159f / moonLatSegments;
+            float phi = lon * 2.0f * 3.14159f / moonLonSegments;
             
-            // Generate 4 vertices of the quad (will be split into 2 triangles)
-            auto generateVertex = [&](float theta, float phi) -> std::pair<glm::vec4, glm::vec3> {
-                float craterDisp = generateCraterDisplacement(theta, phi);
-                float r = radius + craterDisp;
-                
-                float x = r * std::sin(theta) * std::cos(phi);
-                float y = r * std::cos(theta);
-                float z = r * std::sin(theta) * std::sin(phi);
-                
-                // Normal is direction from center for sphere
-                glm::vec3 normal = glm::normalize(glm::vec3(x, y, z));
-                
-                return {glm::vec4(x, y, z, 1.0f), normal};
-            };
+            float craterDisp = generateCraterDisplacement(theta, phi);
+            float r = moonRadius + craterDisp;
             
-            auto [v1, n1] = generateVertex(theta1, phi1);
-            auto [v2, n2] = generateVertex(theta1, phi2);
-            auto [v3, n3] = generateVertex(theta2, phi2);
-            auto [v4, n4] = generateVertex(theta2, phi1);
+            float x = r * std::sin(theta) * std::cos(phi);
+            float y = r * std::cos(theta);
+            float z = r * std::sin(theta) * std::sin(phi);
+            
+            moonMeshX.push_back(x);
+            moonMeshY.push_back(y);
+            moonMeshZ.push_back(z);
             
-            // Draw two triangles for each quad
-            drawMoonTriangle(v1, v2, v3, n1, n2, n3, light, material);
-            drawMoonTriangle(v1, v3, v4, n1, n3, n4, light, material);
+            // Normal is direction from center for sphere
+            moonMeshNormals.push_back(glm::normalize(glm::vec3(x, y, z)));
         }
     }
+    
+    // Two triangles for each quad
+    for (int lat = 0; lat < moonLatSegments; ++lat) {
+        for (int lon = 0; lon < moonLonSegments; ++lon) {
+            uint32_t v1 = static_cast<uint32_t>(lat * columns + lon);
+            uint32_t v2 = v1 + 1;
+            uint32_t v4 = v1 + columns;
+            uint32_t v3 = v4 + 1;
+            
+            moonMeshIndices.push_back(v1);
+            moonMeshIndices.push_back(v2);
+            moonMeshIndices.push_back(v3);
+            moonMeshIndices.push_back(v1);
+            moonMeshIndices.push_back(v3);
+            moonMeshIndices.push_back(v4);
+        }
+    }
+    
+    moonMeshDirty = false;
 }
 
 /**
- * @brief Draws a single moon triangle with lighting
+ * @brief Draws a moon sphere with craters using manual triangle rasterization
+ * 
+ * The geometry comes from the cached mesh (see buildMoonMesh()); only the
+ * view-dependent work is done per frame, in two stages:
+ * 1. Vertex processing: every unique mesh vertex is transformed once into
+ *    the screen-space vertex buffer moonVertices (transformMoonVertices()).
+ * 2. Primitive assembly: triangles read their corners from that buffer by
+ *    index to be clipped and culled (addMoonTriangle()). The vertices of
+ *    surviving triangles are lit on first use, so each one is lit once,
+ *    however many triangles share it, and vertices of culled triangles not
+ *    at all.
  */
-void Engine::drawMoonTriangle(const glm::vec4& v1, const glm::vec4& v2, const glm::vec4& v3,
-                               const glm::vec3& n1, const glm::vec3& n2, const glm::vec3& n3,
-                               const Light& light, const Material& material) {
-    // Transform vertices
-    glm::vec4 v1Clip = transform->transformVertex(v1);
-    glm::vec4 v2Clip = transform->transformVertex(v2);
-    glm::vec4 v3Clip = transform->transformVertex(v3);
+void Engine::drawMoon() {
+    if (moonMeshDirty) {
+        buildMoonMesh();
+    }
     
-    // Perspective division
-    glm::vec4 v1NDC = v1Clip / v1Clip.w;
-    glm::vec4 v2NDC = v2Clip / v2Clip.w;
-    glm::vec4 v3NDC = v3Clip / v3Clip.w;
+    // Collect the frame's moon triangles and submit them as one indexed batch
+    // (the arrays keep their capacity from frame to frame)
+    moonIndices.clear();
+    rasterizer->setCullMode(cullMode);
+    rasterizer->setShadingModel(shadingModel);
+    rasterizer->setShaderUniforms(moonLight, moonMaterial, cameraPos);
+    
+    // The prepass needs per-pixel triangle indices (edge function forward shading)
+    deferMoonLighting = depthPrepass && !rasterizer->getVisibilityBuffer() && 
+                        rasterizer->getRasterMode() == RASTER_EDGE_FUNCTION;
+    
+    // Cached by Transform: the inverse is only redone in frames where the
+    // rotation or scale changed (see update())
+    const glm::mat4& model = transform->getModelMatrix();
+    const glm::mat3& normalMatrix = transform->getModelNormalMatrix();
+    transformMoonVertices(model, normalMatrix);
+    
+    for (size_t i = 0; i < moonMeshIndices.size(); i += 3) {
+        addMoonTriangle(moonMeshIndices[i + 0], moonMeshIndices[i + 1], moonMeshIndices[i + 2],
+                        model, normalMatrix);
+    }
     
-    // Viewport transformation
-    glm::vec2 v1Screen = transform->viewportTransform(v1NDC, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
-    glm::vec2 v2Screen = transform->viewportTransform(v2NDC, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
-    glm::vec2 v3Screen = transform->viewportTransform(v3NDC, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+    // addMoonTriangle() culled the batch already
+    if (deferMoonLighting) {
+        drawMoonWithPrepass();
+    } else {
+        rasterizer->drawIndexed(moonVertices.data(), moonIndices.data(), 
+                                static_cast<int>(moonIndices.size()), true, true);
+    }
+    rasterizer->setCullMode(CULL_NONE);
+    rasterizer->setShadingModel(SHADING_GOURAUD);
+}
+
+/**
+ * @brief Draws the moon batch as a depth prepass followed by a Z-equal shading pass
+ * 
+ * The batch arrives unlit. The prepass rasterizes depth only and finds the
+ * triangles that own at least one pixel; only their vertices are lit. The
+ * shading pass submits the whole batch again: the rasterizer drops the
+ * hidden triangles and shades each pixel for its owner only. Back-facing
+ * and occluded triangles thus cost neither vertex lighting nor pixel
+ * shading, which pays off as lighting gets more expensive than the extra
+ * depth-only pass.
+ */
+void Engine::drawMoonWithPrepass() {
+    int triangleCount = static_cast<int>(moonIndices.size() / 3);
     
-    // Create Vertex structures
-    Vertex vert1, vert2, vert3;
+    rasterizer->beginDepthPrepass();
+    rasterizer->drawIndexed(moonVertices.data(), moonIndices.data(), 
+                            static_cast<int>(moonIndices.size()), true, true);
+    rasterizer->endDepthPrepass();
     
-    vert1.position = glm::vec4(v1Screen.x, v1Screen.y, v1NDC.z, 1.0f);
-    vert2.position = glm::vec4(v2Screen.x, v2Screen.y, v2NDC.z, 1.0f);
-    vert3.position = glm::vec4(v3Screen.x, v3Screen.y, v3NDC.z, 1.0f);
+    for (int i = 0; i < triangleCount; ++i) {
+        if (!rasterizer->isPrepassTriangleVisible(i)) continue;
+        
+        for (int k = 0; k < 3; ++k) {
+            uint32_t index = moonIndices[i * 3 + k];
+            if (!moonVertexLit[index]) {
+                lightMoonVertex(moonVertices[index], moonLight, moonMaterial);
+                moonVertexLit[index] = 1;
+            }
+        }
+    }
     
-    // Calculate world positions
-    glm::mat4 model = transform->getModelMatrix();
-    vert1.worldPos = glm::vec3(model * v1);
-    vert2.worldPos = glm::vec3(model * v2);
-    vert3.worldPos = glm::vec3(model * v3);
-    
-    // Transform normals
-    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
-    vert1.normal = glm::normalize(normalMatrix * n1);
-    vert2.normal = glm::normalize(normalMatrix * n2);
-    vert3.normal = glm::normalize(normalMatrix * n3);
-    
-    // Calculate Gouraud shading colors
-    vert1.color = Shaders::computeGouraudShading(vert1.worldPos, vert1.normal, 
-                                                 cameraPos, light, material);
-    vert2.color = Shaders::computeGouraudShading(vert2.worldPos, vert2.normal, 
-                                                 cameraPos, light, material);
-    vert3.color = Shaders::computeGouraudShading(vert3.worldPos, vert3.normal, 
-                                                 cameraPos, light, material);
+    rasterizer->drawIndexed(moonVertices.data(), moonIndices.data(), 
+                            static_cast<int>(moonIndices.size()), true, true);
+    rasterizer->setDepthTest(DEPTH_TEST_LESS);
+}
+
+/**
+ * @brief Vertex processing: transforms every moon mesh vertex once into moonVertices
+ * 
+ * Fills the clip-space positions read by clipping and the screen-space
+ * vertices (with world position and normal) read by the rasterizer, at the
+ * mesh vertex indices. Lighting waits for emitMoonTriangle(). Vertices
+ * behind the eye get a zero screen position, but triangles using them are
+ * always clipped, which creates new vertices.
+ */
+void Engine::transformMoonVertices(const glm::mat4& model, const glm::mat3& normalMatrix) {
+    int vertexCount = static_cast<int>(moonMeshX.size());
+    moonClipPositions.resize(vertexCount);
+    moonScreenPositions.resize(vertexCount);
+    moonVertices.resize(vertexCount);
+    moonVertexLit.assign(vertexCount, 0);
+    
+    // Positions in one batched SIMD pass, then the lighting attributes
+    transform->transformVertices(moonMeshX.data(), moonMeshY.data(), moonMeshZ.data(), 
+                                 vertexCount, VIEWPORT_WIDTH, VIEWPORT_HEIGHT,
+                                 moonClipPositions.data(), moonScreenPositions.data());
+    for (int i = 0; i < vertexCount; ++i) {
+        moonVertices[i] = makeMoonVertex(moonScreenPositions[i], moonMeshPosition(i), 
+                                         moonMeshNormals[i], model, normalMatrix);
+    }
+}
+
+/**
+ * @brief Primitive assembly: clips and culls one moon triangle of transformed
+ * vertices and appends it to the moon batch
+ * 
+ * Triangles crossing the near plane or the guard band are clipped in clip
+ * space before the perspective division (Transform::clipTriangle). The
+ * resulting polygon is appended as a triangle fan whose new vertices
+ * interpolate the input positions and normals.
+ * 
+ * Every triangle, unclipped or of a fan, is face-culled here on its
+ * projected positions, so culled triangles never reach the lighting code
+ * and the rasterizer does not have to test the batch again.
+ * 
+ * @param i1, i2, i3 Indices of the corners in the mesh and in moonVertices
+ */
+void Engine::addMoonTriangle(uint32_t i1, uint32_t i2, uint32_t i3,
+                             const glm::mat4& model, const glm::mat3& normalMatrix) {
+    ClippedPolygon polygon;
+    TriangleClipResult clipResult = transform->clipTriangle(
+        moonClipPositions[i1], moonClipPositions[i2], moonClipPositions[i3], polygon);
+    if (clipResult == TRIANGLE_REJECTED) return;
+    
+    if (clipResult == TRIANGLE_ACCEPTED) {
+        if (rasterizer->cullTriangle(moonVertices[i1].position, moonVertices[i2].position, 
+                                     moonVertices[i3].position)) return;
+        emitMoonTriangle(i1, i2, i3);
+        return;
+    }
     
-    // Rasterize the triangle
-    rasterizer->drawTriangle(vert1, vert2, vert3, true);
+    // Clipped: interpolate the new vertices and emit the polygon as a fan
+    uint32_t base = static_cast<uint32_t>(moonVertices.size());
+    for (int i = 0; i < polygon.count; ++i) {
+        const glm::vec3& w = polygon.weights[i];
+        glm::vec4 position = moonMeshPosition(i1) * w.x + moonMeshPosition(i2) * w.y + 
+                             moonMeshPosition(i3) * w.z;
+        glm::vec3 normal = moonMeshNormals[i1] * w.x + moonMeshNormals[i2] * w.y + 
+                           moonMeshNormals[i3] * w.z;
+        moonVertices.push_back(makeMoonVertex(projectToScreen(polygon.position[i]), position, 
+                                              normal, model, normalMatrix));
+        moonVertexLit.push_back(0);
+    }
+    for (int i = 1; i + 1 < polygon.count; ++i) {
+        if (rasterizer->cullTriangle(moonVertices[base].position, 
+                                     moonVertices[base + i].position, 
+                                     moonVertices[base + i + 1].position)) continue;
+        emitMoonTriangle(base, base + i, base + i + 1);
+    }
+}
+
+/**
+ * @brief Appends a triangle of moonVertices to the batch, lighting its
+ * vertices on first use (unless lighting waits for the depth prepass)
+ */
+void Engine::emitMoonTriangle(uint32_t i1, uint32_t i2, uint32_t i3) {
+    const uint32_t corners[3] = {i1, i2, i3};
+    for (uint32_t index : corners) {
+        if (!deferMoonLighting && !moonVertexLit[index]) {
+            lightMoonVertex(moonVertices[index], moonLight, moonMaterial);
+            moonVertexLit[index] = 1;
+        }
+        moonIndices.push_back(index);
+    }
+}
+
+/**
+ * @brief Maps a clipped clip-space position to screen space (x, y, NDC depth, 1/w)
+ * 
+ * 1/w is kept so the rasterizer can interpolate attributes perspective-correctly.
+ */
+glm::vec4 Engine::projectToScreen(const glm::vec4& clipPos) const {
+    // Perspective division (clipping guarantees w > 0)
+    glm::vec4 ndc = clipPos / clipPos.w;
+    
+    // Viewport transformation
+    glm::vec2 screen = transform->viewportTransform(ndc, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+    
+    return glm::vec4(screen.x, screen.y, ndc.z, 1.0f / clipPos.w);
+}
+
+/**
+ * @brief Builds an unlit moon vertex from its screen position and model-space attributes
+ */
+Vertex Engine::makeMoonVertex(const glm::vec4& screenPos, const glm::vec4& position, 
+                              const glm::vec3& normal, const glm::mat4& model,
+                              const glm::mat3& normalMatrix) {
+    Vertex vertex;
+    vertex.position = screenPos;
+    vertex.worldPos = glm::vec3(model * position);
+    vertex.normal = glm::normalize(normalMatrix * normal);
+    return vertex;
+}
+
+/**
+ * @brief Computes a moon vertex's Gouraud shading color (Phong lights per pixel instead)
+ */
+void Engine::lightMoonVertex(Vertex& vertex, const Light& light, const Material& material) {
+    if (shadingModel != SHADING_PHONG) {
+        vertex.color = Shaders::computeGouraudShading(vertex.worldPos, vertex.normal, 
+                                                      cameraPos, light, material);
+    }
 }
 
 /**
@@ -610,7 +743,7 @@ void Engine::drawCube() {
         vert3.position = glm::vec4(v3Screen.x, v3Screen.y, v3NDC.z, 1.0f);
         
         // Calculate world positions for lighting
-        glm::mat4 model = transform->getModelMatrix();
+        const glm::mat4& model = transform->getModelMatrix();
         vert1.worldPos = glm::vec3(model * cubeVertices[face.v1]);
         vert2.worldPos = glm::vec3(model * cubeVertices[face.v2]);
         vert3.worldPos = glm::vec3(model * cubeVertices[face.v3]);
@@ -854,23 +987,116 @@ void Engine::keyCallback(GLFWwindow* window, int key, int scancode, int action,
         // Rotation controls
         if (key == GLFW_KEY_UP) {
             g_engine->rotationX += 0.1f;
+            g_engine->modelMatrixDirty = true;
         }
         if (key == GLFW_KEY_DOWN) {
             g_engine->rotationX -= 0.1f;
+            g_engine->modelMatrixDirty = true;
         }
         if (key == GLFW_KEY_LEFT) {
             g_engine->rotationY -= 0.1f;
+            g_engine->modelMatrixDirty = true;
         }
         if (key == GLFW_KEY_RIGHT) {
             g_engine->rotationY += 0.1f;
+            g_engine->modelMatrixDirty = true;
         }
         
         // Scale controls
         if (key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD) {  // '+' key
             g_engine->scale *= 1.1f;
+            g_engine->modelMatrixDirty = true;
         }
         if (key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_SUBTRACT) {  // '-' key
             g_engine->scale *= 0.9f;
+            g_engine->modelMatrixDirty = true;
+        }
+        
+        // Toggle triangle fill algorithm (for benchmarking)
+        if (key == GLFW_KEY_T) {
+            Rasterizer* r = g_engine->rasterizer;
+            if (r->getRasterMode() == RASTER_EDGE_FUNCTION) {
+                r->setRasterMode(RASTER_SCANLINE);
+                std::cout << "Raster mode: scanline" << std::endl;
+            } else {
+                r->setRasterMode(RASTER_EDGE_FUNCTION);
+                std::cout << "Raster mode: edge function" << std::endl;
+            }
+        }
+        
+        // Toggle visibility buffer (deferred shading)
+        if (key == GLFW_KEY_V) {
+            Rasterizer* r = g_engine->rasterizer;
+            r->setVisibilityBuffer(!r->getVisibilityBuffer());
+            std::cout << "Visibility buffer: " << (r->getVisibilityBuffer() ? "on" : "off") << std::endl;
+        }
+        
+        // Toggle per-pixel Phong shading (forward and visibility buffer modes)
+        if (key == GLFW_KEY_P) {
+            bool phong = g_engine->shadingModel != SHADING_PHONG;
+            g_engine->shadingModel = phong ? SHADING_PHONG : SHADING_GOURAUD;
+            std::cout << "Shading model: " << (phong ? "Phong" : "Gouraud") << std::endl;
+        }
+        
+        // Cycle face culling of the moon: back -> front -> none
+        if (key == GLFW_KEY_C) {
+            static const char* names[] = {"none", "back", "front"};
+            g_engine->cullMode = static_cast<CullMode>((g_engine->cullMode + 1) % 3);
+            std::cout << "Cull mode: " << names[g_engine->cullMode] << " ("
+                      << g_engine->rasterizer->getCulledTriangleCount() 
+                      << " triangles culled last frame)" << std::endl;
+        }
+        
+        // Toggle 4x multisample anti-aliasing
+        if (key == GLFW_KEY_M) {
+            Rasterizer* r = g_engine->rasterizer;
+            r->setMultisampling(!r->getMultisampling());
+            std::cout << "4x MSAA: " << (r->getMultisampling() ? "on" : "off") << std::endl;
+        }
+        
+        // Cycle depth buffer format: float32 -> unorm24 -> unorm16
+        if (key == GLFW_KEY_Z) {
+            static const char* names[] = {"float32", "unorm24", "unorm16"};
+            Rasterizer* r = g_engine->rasterizer;
+            r->setDepthFormat(static_cast<DepthFormat>((r->getDepthFormat() + 1) % 3));
+            std::cout << "Depth format: " << names[r->getDepthFormat()] << " ("
+                      << r->getBytesPerDepth() << " bytes per pixel)" << std::endl;
+        }
+        
+        // Toggle parallel rasterization: tile binning / sort-last atomics
+        if (key == GLFW_KEY_A) {
+            Rasterizer* r = g_engine->rasterizer;
+            bool sortLast = r->getParallelMode() != PARALLEL_SORT_LAST;
+            r->setParallelMode(sortLast ? PARALLEL_SORT_LAST : PARALLEL_TILE_BINNING);
+            std::cout << "Parallel mode: " << (sortLast ? "sort-last (atomic)" : "tile binning") 
+                      << std::endl;
+        }
+        
+        // Toggle the moon's depth prepass (edge function forward shading only)
+        if (key == GLFW_KEY_D) {
+            g_engine->depthPrepass = !g_engine->depthPrepass;
+            std::cout << "Depth prepass: " << (g_engine->depthPrepass ? "on" : "off") << std::endl;
+        }
+        
+        // Reseed the procedural craters (the moon mesh is rebuilt next frame)
+        if (key == GLFW_KEY_N) {
+            g_engine->craterSeed++;
+            g_engine->moonMeshDirty = true;
+            std::cout << "Crater field seed: " << g_engine->craterSeed << std::endl;
+        }
+        
+        // Triangle sizes of the last frame (for tuning the small-triangle path)
+        if (key == GLFW_KEY_H) {
+            Rasterizer* r = g_engine->rasterizer;
+            std::cout << "Triangle bounding boxes (longer side, pixels):" << std::endl;
+            for (int bucket = 0; bucket < Rasterizer::SIZE_HISTOGRAM_BUCKETS; ++bucket) {
+                bool last = bucket == Rasterizer::SIZE_HISTOGRAM_BUCKETS - 1;
+                std::cout << (last ? "  >  " : "  <= ") << (1 << (last ? bucket - 1 : bucket))
+                          << ": " << r->getTriangleSizeCount(bucket) << std::endl;
+            }
+            std::cout << "  Small triangles covering no pixel: " 
+                      << r->getEmptySmallTriangleCount() << " (threshold " 
+                      << r->getSmallTriangleSize() << " px)" << std::endl;
         }
         
         // Reset
@@ -879,6 +1105,7 @@ void Engine::keyCallback(GLFWwindow* window, int key, int scancode, int action,
             g_engine->rotationY = 0.0f;
             g_engine->rotationZ = 0.0f;
             g_engine->scale = 1.0f;
+            g_engine->modelMatrixDirty = true;
             std::cout << "Transformations reset" << std::endl;
         }
     }